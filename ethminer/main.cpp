@@ -33,6 +33,7 @@
 #endif
 #if ETH_ETHASHCPU
 #include <libethash-cpu/CPUMiner.h>
+#include <libethash-cpu/CPUTopology.h>
 #endif
 #include <libpoolprotocols/PoolManager.h>
 
@@ -108,11 +109,11 @@ public:
         if (!ec && g_running)
         {
             string logLine =
-                PoolManager::p().isConnected() ? Farm::f().Telemetry().str() : "Not connected";
+                PoolManager::p().isConnected() ? Farm::f().Telemetry()->str() : "Not connected";
             minelog << logLine;
 
 #if ETH_DBUS
-            dbusint.send(Farm::f().Telemetry().str());
+            dbusint.send(Farm::f().Telemetry()->str());
 #endif
             // Resubmit timer
             m_cliDisplayTimer.expires_from_now(boost::posix_time::seconds(m_cliDisplayInterval));
@@ -361,11 +362,57 @@ public:
 
         app.add_option("--cpu-devices,--cp-devices", m_CPSettings.devices, "");
 
+        app.add_option("--cp-interleave", m_CPSettings.interleave, "", true)
+            ->check(CLI::Range(0, 16));
+
+        string cpPages = "1g";
+        app.add_set("--cp-pages", cpPages, {"1g", "2m", "thp", "none"}, "", true);
+
+        app.add_flag("--cp-numa", m_CPSettings.numa, "");
+
+        app.add_option("--cp-dag-threads", m_CPSettings.dagThreads, "", true)
+            ->check(CLI::Range(0, 4096));
+
+        app.add_flag("--cp-precompute", m_CPSettings.precompute, "");
+
+        app.add_option("--cp-switch-latency", m_CPSettings.switchLatency, "", true)
+            ->check(CLI::Range(50, 1000000));
+
+        string cpCpus = "logical";
+        app.add_option("--cp-cpus", cpCpus, "", true);
+
+        string cpGroup = "cpu";
+        app.add_set("--cp-group", cpGroup, {"cpu", "socket", "host"}, "", true);
+
+        app.add_flag("--cp-light", m_CPSettings.light, "");
+
+        app.add_option("--cp-light-cache", m_CPSettings.lightCache, "", true)
+            ->check(CLI::Range(0, 65536));
+
+        app.add_option("--cp-light-bench", m_cpLightBench, "", true)->check(CLI::Range(0, 2047));
+
+        string cpKernel = "auto";
+        app.add_set(
+            "--cp-kernel", cpKernel, {"auto", "generic", "sse4.1", "avx2", "avx512"}, "", true);
+
 #endif
 
         app.add_flag("--noeval", m_FarmSettings.noEval, "");
 
-        app.add_option("-L,--dag-load-mode", m_FarmSettings.dagLoadMode, "", true)->check(CLI::Range(1));
+        bool eval = false;
+        app.add_flag("--eval", eval, "");
+
+        app.add_option("--eval-threads", m_FarmSettings.evalThreads, "", true)
+            ->check(CLI::Range(0, 64));
+
+        app.add_option("--history", m_FarmSettings.historyHours, "", true)
+            ->check(CLI::Range(0, 720));
+
+        unsigned dagLoadMode = 0;
+        app.add_option("-L,--dag-load-mode", dagLoadMode, "", true)->check(CLI::Range(1));
+
+        app.add_option("--dag-load-limit", m_FarmSettings.dagLoadLimit, "", true)
+            ->check(CLI::Range(0, 64));
 
         bool cl_miner = false;
         app.add_flag("-G,--opencl", cl_miner, "");
@@ -384,12 +431,20 @@ public:
 
         app.add_option("--pow-start", m_PoolSettings.sysCallbackPoWStart, "");
         app.add_option("--pow-end", m_PoolSettings.sysCallbackPoWEnd, "");
-        app.add_flag("--clear-dag", m_PoolSettings.clearDAGPoWEnd, "");
+        bool clearDag = false;
+        app.add_flag("--clear-dag", clearDag, "");
+        string standby;
+        app.add_set("--standby", standby, {"resident", "host", "clear"}, "", true);
         app.add_flag("--pow-end-at-startup", m_PoolSettings.callPoWEndAtStartup, "");
 
         app.add_option("--pow-earlier", m_PoolSettings.startPoWEarlier, "", true)
             ->check(CLI::Range(1, 99999));
 
+        app.add_option("--dag-dir", m_FarmSettings.dagDir, "", true);
+        unsigned dagDirMax = 0;
+        app.add_option("--dag-dir-max", dagDirMax, "", true)->check(CLI::Range(0, 65536));
+        app.add_flag("--dag-verify", m_FarmSettings.dagVerify, "");
+
         // Exception handling is held at higher level
         app.parse(argc, argv);
         if (bhelp)
@@ -407,6 +462,19 @@ public:
             return false;
         }
 
+        m_FarmSettings.dagDirMax = uint64_t(dagDirMax) << 30;
+        if (dagLoadMode == 1 && !m_FarmSettings.dagLoadLimit)
+            m_FarmSettings.dagLoadLimit = 1;
+        if (clearDag && standby.empty())
+            standby = "clear";
+        m_PoolSettings.standbyPoWEnd = !standby.empty();
+        if (standby == "host")
+            m_PoolSettings.standbyMode = DagStandbyEnum::Host;
+        else if (standby == "clear")
+            m_PoolSettings.standbyMode = DagStandbyEnum::Clear;
+        if (eval)
+            m_FarmSettings.noEval = false;
+
 
 #ifndef DEV_BUILD
 
@@ -449,7 +517,7 @@ public:
             m_mode = OperationMode::Mining;
         }
 
-        if (!m_shouldListDevices && m_mode != OperationMode::Simulation)
+        if (!m_shouldListDevices && m_cpLightBench < 0 && m_mode != OperationMode::Simulation)
         {
             if (!pools.size())
                 throw std::invalid_argument(
@@ -488,6 +556,44 @@ public:
         }
 
 
+#if ETH_ETHASHCPU
+        if (cpPages == "1g")
+            m_CPSettings.pages = PageBackingEnum::Huge1G;
+        else if (cpPages == "2m")
+            m_CPSettings.pages = PageBackingEnum::Huge2M;
+        else if (cpPages == "thp")
+            m_CPSettings.pages = PageBackingEnum::Transparent;
+        else if (cpPages == "none")
+            m_CPSettings.pages = PageBackingEnum::Normal;
+
+        if (cpKernel == "generic")
+            m_CPSettings.kernel = CPUKernelEnum::Generic;
+        else if (cpKernel == "sse4.1")
+            m_CPSettings.kernel = CPUKernelEnum::SSE41;
+        else if (cpKernel == "avx2")
+            m_CPSettings.kernel = CPUKernelEnum::AVX2;
+        else if (cpKernel == "avx512")
+            m_CPSettings.kernel = CPUKernelEnum::AVX512;
+        if (cpCpus == "physical")
+            m_CPSettings.cpuSelect = CPUSelectEnum::Physical;
+        else if (cpCpus != "logical")
+        {
+            m_CPSettings.cpuSelect = CPUSelectEnum::List;
+            if (!parseCpuList(cpCpus, m_CPSettings.cpuList) || m_CPSettings.cpuList.empty())
+                throw std::invalid_argument("Invalid --cp-cpus " + cpCpus);
+        }
+
+        if (cpGroup == "socket")
+            m_CPSettings.group = CPUGroupEnum::Socket;
+        else if (cpGroup == "host")
+            m_CPSettings.group = CPUGroupEnum::Host;
+
+        if (!selectCPUKernel(m_CPSettings.kernel))
+            throw std::invalid_argument("CPU kernel " + cpKernel +
+                                        " can't run on this host. CPU features: " +
+                                        cpuFeatures().str());
+#endif
+
 #if ETH_ETHASHCUDA
         if (sched == "auto")
             m_CUSettings.schedule = 0;
@@ -525,6 +631,29 @@ public:
 
     void execute()
     {
+#if ETH_ETHASHCPU
+        // Hashrate against memory of light mode, then exit
+        if (m_cpLightBench >= 0)
+        {
+            const vector<unsigned> cacheMiB = {0, 1, 4, 16, 64, 256};
+            const uint64_t dagSize = ethash::get_full_dataset_size(
+                ethash::calculate_full_dataset_num_items(m_cpLightBench));
+            cout << "Light mode on one thread, epoch " << m_cpLightBench << ", DAG "
+                 << getFormattedMemory((double)dagSize) << endl;
+            cout << setw(13) << "Item cache" << setw(13) << "Memory" << setw(10) << "DAG/Mem"
+                 << setw(10) << "Hit rate" << setw(12) << "Hashrate" << endl;
+            for (const auto& p : CPUMiner::benchLight(m_cpLightBench, cacheMiB, 5))
+            {
+                cout << setw(13) << getFormattedMemory((double)p.itemCache) << setw(13)
+                     << getFormattedMemory((double)p.memory) << setw(9) << std::fixed
+                     << std::setprecision(1) << double(dagSize) / p.memory << "x" << setw(9)
+                     << 100.0 * p.hitRate << "%" << setw(10) << uint64_t(p.hashesPerSecond)
+                     << " H/s" << endl;
+            }
+            return;
+        }
+#endif
+
 #if ETH_ETHASHCL
         if (m_minerType == MinerType::CL || m_minerType == MinerType::Mixed)
             CLMiner::enumDevices(m_DevicesCollection);
@@ -535,7 +664,7 @@ public:
 #endif
 #if ETH_ETHASHCPU
         if (m_minerType == MinerType::CPU)
-            CPUMiner::enumDevices(m_DevicesCollection);
+            CPUMiner::enumDevices(m_DevicesCollection, m_CPSettings);
 #endif
 
         // Can't proceed without any GPU
@@ -650,6 +779,28 @@ public:
                 it++;
             }
 
+#if ETH_ETHASHCPU
+            if (m_minerType == MinerType::CPU)
+            {
+                const CPUKernel& active = activeCPUKernel();
+                cout << endl << "CPU topology : " << readCPUTopology().str() << endl;
+                cout << "CPU features : " << cpuFeatures().str() << endl;
+                cout << "CPU kernels  :";
+                for (auto k : {CPUKernelEnum::Generic, CPUKernelEnum::SSE41, CPUKernelEnum::AVX2,
+                         CPUKernelEnum::AVX512})
+                {
+                    const CPUKernel& kernel = cpuKernel(k);
+                    cout << " [" << kernel.name;
+                    if (&kernel == &active)
+                        cout << ", in use";
+                    else if (!isCPUKernelUsable(k))
+                        cout << ", n/a";
+                    cout << "]";
+                }
+                cout << endl;
+            }
+#endif
+
             return;
         }
 
@@ -983,6 +1134,73 @@ public:
                  << "                        Space separated list of device indexes to use" << endl
                  << "                        eg --cp-devices 0 2 3" << endl
                  << "                        If not set all available CPUs will be used" << endl
+                 << "    --cp-interleave     UINT [0 .. 16] Default = 8" << endl
+                 << "                        Number of nonces hashed in lockstep per thread" << endl
+                 << "                        DAG reads of all of them are prefetched together"
+                 << endl
+                 << "                        0 hashes one nonce at a time" << endl
+                 << "    --cp-pages          TEXT {1g,2m,thp,none} Default = 1g" << endl
+                 << "                        Largest memory pages to back the DAG with" << endl
+                 << "                        Smaller ones are tried in turn if unavailable:" << endl
+                 << "                        '1g'   1 GiB huge pages (hugetlbfs)" << endl
+                 << "                        '2m'   2 MiB huge pages (hugetlbfs)" << endl
+                 << "                        'thp'  Transparent huge pages" << endl
+                 << "                        'none' Normal pages" << endl
+                 << "                        Run with -M and different values to compare" << endl
+                 << "    --cp-numa           FLAG" << endl
+                 << "                        Build one DAG replica per NUMA node in its local"
+                 << endl
+                 << "                        memory. Each CPU reads the replica of its node" << endl
+                 << "    --cp-dag-threads    UINT [0 .. 4096] Default = 0" << endl
+                 << "                        Number of threads generating the DAG" << endl
+                 << "                        0 uses all CPUs the process is allowed to run on"
+                 << endl
+                 << "    --cp-precompute     FLAG" << endl
+                 << "                        Generate the DAG of the next PoW window ahead of" << endl
+                 << "                        time, at idle priority, as soon as the pool tells"
+                 << endl
+                 << "                        its epoch. Needs memory for two DAGs" << endl
+                 << "    --cp-switch-latency UINT [50 .. 1000000] Default = 1000" << endl
+                 << "                        Bound, in microseconds, of the time taken to" << endl
+                 << "                        switch to a new job. Nonces are hashed in batches"
+                 << endl
+                 << "                        sized at runtime to fit in it" << endl
+                 << "    --cp-cpus           TEXT Default = logical" << endl
+                 << "                        CPUs to run a mining thread on, among those the"
+                 << endl
+                 << "                        process is allowed (affinity, cgroup cpuset):" << endl
+                 << "                        'logical'  Every logical CPU" << endl
+                 << "                        'physical' One logical CPU per physical core" << endl
+                 << "                        A list of CPU numbers, eg 0-3,8,10" << endl
+                 << "                        A cgroup CPU quota caps the number of threads" << endl
+                 << "    --cp-group          TEXT {cpu,socket,host} Default = cpu" << endl
+                 << "                        'cpu'    One miner per CPU" << endl
+                 << "                        'socket' One miner per socket, its CPUs sharing"
+                 << endl
+                 << "                        the nonces of the miner on a thread pool" << endl
+                 << "                        'host'   Likewise with one miner for all CPUs" << endl
+                 << "    --cp-light          FLAG" << endl
+                 << "                        Don't generate the DAG: calculate the items read"
+                 << endl
+                 << "                        by each hash from the light cache. Needs about 60"
+                 << endl
+                 << "                        times less memory for a fraction of the hashrate"
+                 << endl
+                 << "    --cp-light-cache    UINT [0 .. 65536] Default = 8" << endl
+                 << "                        MiB of recently calculated items kept by each"
+                 << endl
+                 << "                        hashing thread in light mode" << endl
+                 << "    --cp-light-bench    UINT [0 .. 2047] Default not set" << endl
+                 << "                        Measure light mode hashrate and memory for a range"
+                 << endl
+                 << "                        of item cache sizes at the given epoch, then exit"
+                 << endl
+                 << "    --cp-kernel         TEXT {auto,generic,sse4.1,avx2,avx512} Default = auto"
+                 << endl
+                 << "                        Instruction set of the hashing kernels. 'auto' picks"
+                 << endl
+                 << "                        the best one this CPU supports. See --list-devices"
+                 << endl
                  << endl;
         }
 
@@ -1051,6 +1269,15 @@ public:
                  << "                        found nonces. Trims some ms. from submission" << endl
                  << "                        time but it may increase rejected solution rate."
                  << endl
+                 << "    --eval              FLAG Re-evaluate found nonces on the host before" << endl
+                 << "                        submitting them. Off by default" << endl
+                 << "    --eval-threads      UINT[0 .. 64] Default = 0" << endl
+                 << "                        Number of threads re-evaluating found nonces" << endl
+                 << "                        0 uses up to 4, as many as there are CPUs" << endl
+                 << "    --history           UINT[0 .. 720] Default = 24" << endl
+                 << "                        Hours of telemetry kept in memory for the API" << endl
+                 << "                        method miner_gethistory, 0 to disable. About" << endl
+                 << "                        0.5 MiB per device and day" << endl
                  << "    --list-devices      FLAG Lists the detected OpenCL/CUDA devices and "
                     "exits"
                  << endl
@@ -1059,6 +1286,20 @@ public:
                  << "                        Set DAG load mode. Can be one of:" << endl
                  << "                        0 Parallel load mode (each GPU independently)" << endl
                  << "                        1 Sequential load mode (one GPU after another)" << endl
+                 << "    --dag-load-limit    UINT[0 .. 64] Default = 0" << endl
+                 << "                        Most GPUs generating their DAG at once, 0 for no" << endl
+                 << "                        limit. Queued GPUs start by increasing time their" << endl
+                 << "                        last generation took. -L 1 is the same as 1" << endl
+                 << "                        CPU miners never wait" << endl
+                 << "    --dag-dir           TEXT Default not set" << endl
+                 << "                        Directory where light caches and DAGs are saved" << endl
+                 << "                        once generated and loaded from on later runs" << endl
+                 << "                        instead of being generated again" << endl
+                 << "    --dag-dir-max       UINT Default = 0" << endl
+                 << "                        Size cap of --dag-dir in GiB. Least recently used" << endl
+                 << "                        files are removed beyond it. 0 for no cap" << endl
+                 << "    --dag-verify        FLAG Verify checksums of files loaded from --dag-dir"
+                 << endl
                  << endl
                  << "    --tstart            UINT[30 .. 100] Default = 0" << endl
                  << "                        Suspend mining on GPU which temperature is above"
@@ -1286,6 +1527,7 @@ private:
     MinerType m_minerType = MinerType::Mixed;
     OperationMode m_mode = OperationMode::None;
     bool m_shouldListDevices = false;
+    int m_cpLightBench = -1;  // Epoch to benchmark the CPU light mode with
 
     FarmSettings m_FarmSettings;  // Operating settings for Farm
     PoolSettings m_PoolSettings;  // Operating settings for PoolManager
@@ -711,6 +711,79 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         }
     }
 
+    else if (_method == "miner_attachgpu" || _method == "miner_detachgpu" ||
+             _method == "miner_restartgpu")
+    {
+        if (!checkApiWriteAccess(m_readonly, jResponse))
+            return;
+
+        Json::Value jRequestParams;
+        if (!getRequestValue("params", jRequestParams, jRequest, false, jResponse))
+            return;
+
+        // A miner index or the PCI id of a device
+        string id;
+        if (jRequestParams.isMember("index"))
+        {
+            unsigned index;
+            if (!getRequestValue("index", index, jRequestParams, false, jResponse))
+                return;
+            id = to_string(index);
+        }
+        else if (!getRequestValue("id", id, jRequestParams, false, jResponse))
+            return;
+
+        try
+        {
+            if (_method == "miner_attachgpu")
+                Farm::f().attachMiner(id);
+            else if (_method == "miner_detachgpu")
+                Farm::f().detachMiner(id);
+            else
+                Farm::f().restartMiner(id);
+            jResponse["result"] = true;
+        }
+        catch (const std::exception& _ex)
+        {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = _ex.what();
+        }
+    }
+
+    else if (_method == "miner_gethistory")
+    {
+        TelemetryHistory* history = Farm::f().history();
+        if (!history)
+        {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = "History is disabled (--history 0)";
+            return;
+        }
+
+        // All optional: the whole history by steps of a minute
+        unsigned from = 0;
+        unsigned to = UINT32_MAX;
+        unsigned step = 60;
+        Json::Value jRequestParams;
+        if (jRequest.isMember("params"))
+        {
+            if (!getRequestValue("params", jRequestParams, jRequest, false, jResponse))
+                return;
+            if (!getRequestValue("from", from, jRequestParams, true, jResponse) ||
+                !getRequestValue("to", to, jRequestParams, true, jResponse) ||
+                !getRequestValue("step", step, jRequestParams, true, jResponse))
+                return;
+        }
+        if (!step || to < from)
+        {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = "Invalid range";
+            return;
+        }
+
+        jResponse["result"] = history->range(from, to, step);
+    }
+
     else if (_method == "miner_setverbosity")
     {
         if (!checkApiWriteAccess(m_readonly, jResponse))
@@ -958,7 +1031,8 @@ void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& e
 Json::Value ApiConnection::getMinerStat1()
 {
     auto connection = PoolManager::p().getActiveConnection();
-    TelemetryType t = Farm::f().Telemetry();
+    std::shared_ptr<const TelemetryType> telemetry = Farm::f().Telemetry();
+    const TelemetryType& t = *telemetry;
     auto runningTime =
         std::chrono::duration_cast<std::chrono::minutes>(steady_clock::now() - t.start);
 
@@ -1068,18 +1142,56 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
     mininginfo["pause_reason"] = _miner->paused() ? _miner->pausedString() : Json::Value::null;
 
     /* Nonce infos */
-    auto segment_width = Farm::f().get_segment_width();
-    uint64_t gpustartnonce = Farm::f().get_nonce_scrambler() + ((uint64_t)_index << segment_width);
-    jsegment.append(toHex(uint64_t(gpustartnonce), HexPrefix::Add));
-    jsegment.append(toHex(uint64_t(gpustartnonce + (1LL << segment_width)), HexPrefix::Add));
+    NonceRange range = Farm::f().get_nonce_range(_index);
+    if (!range.count)
+    {
+        // No job yet: the segment the miner would get with equal shares
+        auto segment_width = Farm::f().get_segment_width();
+        range.start = Farm::f().get_nonce_scrambler() + ((uint64_t)_index << segment_width);
+        range.count = uint64_t(1) << segment_width;
+    }
+    jsegment.append(toHex(range.start, HexPrefix::Add));
+    jsegment.append(toHex(uint64_t(range.start + range.count), HexPrefix::Add));
     mininginfo["segment"] = jsegment;
 
     /* Hash & Share infos */
     mininginfo["hashrate"] = toHex((uint32_t)_t.miners.at(_index).hashrate, HexPrefix::Add);
 
+    DagLoadInfo dagLoad = _miner->dagLoadInfo();
+    if (dagLoad.state != DagLoadState::Idle)
+    {
+        Json::Value dagloadinfo;
+        dagloadinfo["state"] = DagLoadScheduler::stateName(dagLoad.state);
+        dagloadinfo["epoch"] = dagLoad.epoch;
+        dagloadinfo["estimate_ms"] = dagLoad.estimateMs;
+        dagloadinfo["wait_ms"] = dagLoad.waitMs;
+        dagloadinfo["generation_ms"] = dagLoad.generationMs;
+        mininginfo["dag_load"] = dagloadinfo;
+    }
+
+    WorkLatency latency = _miner->workLatency();
+    if (latency.count)
+    {
+        Json::Value latencyinfo;
+        latencyinfo["count"] = latency.count;
+        latencyinfo["last_us"] = latency.lastUs;
+        latencyinfo["avg_us"] = latency.avgUs;
+        latencyinfo["max_us"] = latency.maxUs;
+        mininginfo["work_latency"] = latencyinfo;
+    }
+
+    Json::Value histograms;
+    histograms["work_switch"] = _miner->workLatencyHistogram().json();
+    histograms["dag_load"] = _miner->dagLoadHistogram().json();
+    mininginfo["latency"] = histograms;
+
     jRes["hardware"] = hwinfo;
     jRes["mining"] = mininginfo;
 
+    Json::Value details = _miner->getDetails();
+    if (!details.isNull())
+        jRes["details"] = details;
+
     return jRes;
 }
 
@@ -1197,7 +1309,8 @@ std::string ApiConnection::getHttpMinerStatDetail()
 Json::Value ApiConnection::getMinerStatDetail()
 {
     const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
-    TelemetryType t = Farm::f().Telemetry();
+    std::shared_ptr<const TelemetryType> telemetry = Farm::f().Telemetry();
+    const TelemetryType& t = *telemetry;
 
     auto runningTime = std::chrono::duration_cast<std::chrono::seconds>(
         std::chrono::steady_clock::now() - t.start);
@@ -1246,6 +1359,46 @@ Json::Value ApiConnection::getMinerStatDetail()
                                                                 // found share
     mininginfo["shares"] = sharesinfo;
 
+    if (!t.numaNodes.empty())
+    {
+        Json::Value nodesinfo;
+        for (auto const& node : t.numaNodes)
+            nodesinfo[to_string(node.first)] = toHex(uint32_t(node.second), HexPrefix::Add);
+        mininginfo["numa_nodes"] = nodesinfo;
+    }
+
+    VerifierStats verifier = Farm::f().getVerifierStats();
+    if (verifier.verified || verifier.queueDepth)
+    {
+        Json::Value verifierinfo;
+        verifierinfo["queue_depth"] = verifier.queueDepth;
+        verifierinfo["max_queue_depth"] = verifier.maxQueueDepth;
+        verifierinfo["verified"] = Json::UInt64(verifier.verified);
+        verifierinfo["invalid"] = Json::UInt64(verifier.invalid);
+        verifierinfo["latency_avg_ms"] = verifier.avgLatencyMs;
+        verifierinfo["latency_max_ms"] = verifier.maxLatencyMs;
+        mininginfo["verifier"] = verifierinfo;
+    }
+
+    WorkLatency latency = Farm::f().getWorkLatency();
+    if (latency.count)
+    {
+        Json::Value latencyinfo;
+        latencyinfo["count"] = latency.count;
+        latencyinfo["last_us"] = latency.lastUs;
+        latencyinfo["avg_us"] = latency.avgUs;
+        latencyinfo["max_us"] = latency.maxUs;
+        mininginfo["work_latency"] = latencyinfo;
+    }
+
+    FarmLatency& farmLatency = Farm::f().latency();
+    Json::Value histograms;
+    histograms["work_receive"] = farmLatency.workReceive.json();
+    histograms["solution_check"] = farmLatency.solutionCheck.json();
+    histograms["solution_send"] = farmLatency.solutionSend.json();
+    histograms["solution_ack"] = farmLatency.solutionAck.json();
+    mininginfo["latency"] = histograms;
+
     /* Monitors Info */
     Json::Value monitorinfo;
     auto tstop = Farm::f().get_tstop();
@@ -1259,7 +1412,12 @@ Json::Value ApiConnection::getMinerStatDetail()
 
     /* Devices related info */
     for (shared_ptr<Miner> miner : Farm::f().getMiners())
+    {
+        // Attached since the last collect
+        if (miner->Index() >= t.miners.size())
+            continue;
         devices.append(getMinerStatDetailPerMiner(t, miner));
+    }
 
     jRes["devices"] = devices;
 
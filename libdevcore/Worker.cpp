@@ -35,22 +35,34 @@ void Worker::startWorking()
     Guard l(x_work);
     if (m_work)
     {
-        WorkerState ex = WorkerState::Stopped;
-        m_state.compare_exchange_strong(ex, WorkerState::Starting);
+        // A stopping thread is let finish first
+        unique_lock<mutex> ls(x_state);
+        m_stateChanged.wait(ls, [this]() { return m_state != WorkerState::Stopping; });
+        if (m_state == WorkerState::Stopped)
+        {
+            m_state = WorkerState::Starting;
+            m_stateChanged.notify_all();
+        }
     }
     else
     {
-        m_state = WorkerState::Starting;
+        {
+            lock_guard<mutex> ls(x_state);
+            m_state = WorkerState::Starting;
+        }
         m_work.reset(new thread([&]() {
             setThreadName(m_name.c_str());
             //			cnote << "Thread begins";
-            while (m_state != WorkerState::Killing)
+            while (true)
             {
-                WorkerState ex = WorkerState::Starting;
-                bool ok = m_state.compare_exchange_strong(ex, WorkerState::Started);
-                //				cnote << "Trying to set Started: Thread was" << (unsigned)ex << "; "
-                //<< ok;
-                (void)ok;
+                {
+                    lock_guard<mutex> ls(x_state);
+                    if (m_state == WorkerState::Killing)
+                        break;
+                    if (m_state == WorkerState::Starting)
+                        m_state = WorkerState::Started;
+                }
+                m_stateChanged.notify_all();
 
                 try
                 {
@@ -66,22 +78,19 @@ void Worker::startWorking()
                     }
                 }
 
-                //				ex = WorkerState::Stopping;
-                //				m_state.compare_exchange_strong(ex, WorkerState::Stopped);
-
-                ex = m_state.exchange(WorkerState::Stopped);
-                //				cnote << "State: Stopped: Thread was" << (unsigned)ex;
-                if (ex == WorkerState::Killing || ex == WorkerState::Starting)
-                    m_state.exchange(ex);
-
-                while (m_state == WorkerState::Stopped)
-                    this_thread::sleep_for(chrono::milliseconds(20));
+                // Sleep till restarted or killed
+                unique_lock<mutex> ls(x_state);
+                if (m_state != WorkerState::Killing && m_state != WorkerState::Starting)
+                    m_state = WorkerState::Stopped;
+                m_stateChanged.notify_all();
+                m_stateChanged.wait(ls, [this]() { return m_state != WorkerState::Stopped; });
             }
         }));
         //		cnote << "Spawning" << m_name;
     }
-    while (m_state == WorkerState::Starting)
-        this_thread::sleep_for(chrono::microseconds(20));
+
+    unique_lock<mutex> ls(x_state);
+    m_stateChanged.wait(ls, [this]() { return m_state != WorkerState::Starting; });
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "Worker::startWorking() end");
 }
 
@@ -90,8 +99,12 @@ void Worker::triggerStopWorking()
     DEV_GUARDED(x_work)
     if (m_work)
     {
-        WorkerState ex = WorkerState::Started;
-        m_state.compare_exchange_strong(ex, WorkerState::Stopping);
+        lock_guard<mutex> ls(x_state);
+        if (m_state == WorkerState::Started || m_state == WorkerState::Starting)
+        {
+            m_state = WorkerState::Stopping;
+            m_stateChanged.notify_all();
+        }
     }
 }
 
@@ -101,12 +114,17 @@ void Worker::stopWorking()
     DEV_GUARDED(x_work)
     if (m_work)
     {
-        WorkerState ex = WorkerState::Started;
-        m_state.compare_exchange_strong(ex, WorkerState::Stopping);
+        unique_lock<mutex> ls(x_state);
+        if (m_state == WorkerState::Started || m_state == WorkerState::Starting)
+        {
+            m_state = WorkerState::Stopping;
+            m_stateChanged.notify_all();
+        }
 
         DEV_BUILD_LOG_PROGRAMFLOW(cnote, "Worker::stopWorking() waiting for WorkerState::Stopped begin");
-        while (m_state != WorkerState::Stopped)
-            this_thread::sleep_for(chrono::microseconds(20));
+        m_stateChanged.wait(ls, [this]() {
+            return m_state == WorkerState::Stopped || m_state == WorkerState::Killing;
+        });
         DEV_BUILD_LOG_PROGRAMFLOW(cnote, "Worker::stopWorking() waiting for WorkerState::Stopped end");
     }
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "Worker::stopWorking() end");
@@ -118,7 +136,11 @@ Worker::~Worker()
     DEV_GUARDED(x_work)
     if (m_work)
     {
-        m_state.exchange(WorkerState::Killing);
+        {
+            lock_guard<mutex> ls(x_state);
+            m_state = WorkerState::Killing;
+        }
+        m_stateChanged.notify_all();
         m_work->join();
         m_work.reset();
     }
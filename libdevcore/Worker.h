@@ -24,6 +24,7 @@
 #include <signal.h>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <string>
 #include <thread>
 
@@ -52,13 +53,13 @@ public:
 
     virtual ~Worker();
 
-    /// Starts worker thread; causes startedWorking() to be called.
+    /// Starts worker thread, or restarts a stopped one, and waits till it has started.
     void startWorking();
 
     /// Triggers worker thread it should stop
     void triggerStopWorking();
 
-    /// Stop worker thread; causes call to stopWorking() and waits till thread has stopped.
+    /// Stop worker thread; waits (without spinning) till workLoop() has returned.
     void stopWorking();
 
     /// Whether or not this worker should stop
@@ -71,7 +72,12 @@ private:
 
     mutable Mutex x_work;                 ///< Lock for the network existence.
     std::unique_ptr<std::thread> m_work;  ///< The network thread.
+
+    /// Changed under x_state only, so that waits on m_stateChanged can't miss a change.
+    /// Atomic for shouldStop().
     std::atomic<WorkerState> m_state = {WorkerState::Starting};
+    std::mutex x_state;
+    std::condition_variable m_stateChanged;  ///< A stopped thread sleeps on it too.
 };
 
 }  // namespace dev
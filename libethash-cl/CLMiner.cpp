@@ -24,6 +24,9 @@ namespace eth
 // to the assembly code for the binary kernels.
 const size_t c_maxSearchResults = 15;
 
+// Size of the transfers between the DAG store and the device
+const uint64_t c_dagStoreChunk = 64 * 1024 * 1024;
+
 struct CLChannel : public LogChannel
 {
     static const char* name() { return EthOrange "cl"; }
@@ -264,8 +267,9 @@ CLMiner::CLMiner(unsigned _index, CLSettings _settings, DeviceDescriptor& _devic
 CLMiner::~CLMiner()
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cllog, "cl-" << m_index << " CLMiner::~CLMiner() begin");
-    stopWorking();
+    triggerStopWorking();
     kick_miner();
+    stopWorking();
     DEV_BUILD_LOG_PROGRAMFLOW(cllog, "cl-" << m_index << " CLMiner::~CLMiner() end");
 }
 
@@ -292,11 +296,19 @@ void CLMiner::workLoop()
     uint32_t zerox3[3] = {0, 0, 0};
 
     uint64_t startNonce = 0;
+    uint64_t noncesLeft = 0;  // Of the kernel from startNonce that are the miner's, 0 once taken
     int submitted_count = 0;
 
     // The work package currently processed by GPU.
     WorkPackage current;
     current.header = h256();
+    uint64_t currentNonces = 0;  // Of current from its startNonce that are the miner's
+    uint64_t currentGeneration = c_noWorkGeneration;
+    uint64_t rangeGeneration = c_noWorkGeneration;  // Of the work startNonce was taken from
+
+    // The newest work package, copied only when it changes
+    WorkPackage w;
+    uint64_t generation = c_noWorkGeneration;
 
     if (!initDevice())
     return;
@@ -336,14 +348,12 @@ void CLMiner::workLoop()
             else
                 results.count = 0;
 
-            // Wait for work or 3 seconds (whichever the first)
-            const WorkPackage w = work();
+            // Wait for work
+            if (workGeneration() != generation)
+                w = work(&generation);
             if (!w || paused())
             {
-                boost::system_time const timeout =
-                    boost::get_system_time() + boost::posix_time::seconds(3);
-                boost::mutex::scoped_lock l(x_work);
-                m_new_work_signal.timed_wait(l, timeout);
+                waitForWork(generation);
                 continue;
             }
 
@@ -363,8 +373,6 @@ void CLMiner::workLoop()
                 const uint64_t target = (uint64_t)(u64)((u256)w.boundary >> 192);
                 assert(target > 0);
 
-                startNonce = w.startNonce;
-
                 // Update header constant buffer.
                 m_queue[0].enqueueWriteBuffer(
                     m_header[0], CL_FALSE, 0, w.header.size, w.header.data());
@@ -391,21 +399,35 @@ void CLMiner::workLoop()
 #endif
             }
 
+            // Hot-plug republishes the same job with new ranges
+            if (rangeGeneration != generation)
+            {
+                startNonce = w.startNonce;
+                noncesLeft = restartNonces(w, m_settings.globalWorkSize);
+                rangeGeneration = generation;
+            }
+
             if ((m_maxSubmitCount >= 0) && (submitted_count >= m_maxSubmitCount))
             {
                 continue;
             }
 
             // Run the kernel.
-            m_searchKernel.setArg(4, startNonce);
-            m_queue[0].enqueueNDRangeKernel(
-                m_searchKernel, cl::NullRange, m_settings.globalWorkSize, m_settings.localWorkSize);
+            if (noncesLeft)
+            {
+                m_searchKernel.setArg(4, startNonce);
+                m_queue[0].enqueueNDRangeKernel(m_searchKernel, cl::NullRange,
+                    m_settings.globalWorkSize, m_settings.localWorkSize);
+            }
 
             if (results.count)
             {
                 // Report results while the kernel is running.
                 for (uint32_t i = 0; i < results.count; i++)
                 {
+                    // The end of the kernel may run into another miner's nonces
+                    if (results.rslt[i].gid >= currentNonces)
+                        continue;
                     uint64_t nonce = current.startNonce + results.rslt[i].gid;
                     if (nonce != m_lastNonce)
                     {
@@ -428,10 +450,24 @@ void CLMiner::workLoop()
                 }
             }
 
-            current = w;  // kernel now processing newest work
+            if (!noncesLeft)
+            {
+                // Results of the last kernel are in: wait for the next job
+                waitForWork(generation);
+                continue;
+            }
+
+            // kernel now processing newest work
+            if (currentGeneration != generation)
+            {
+                current = w;
+                currentGeneration = generation;
+                workStarted(generation);
+            }
             current.startNonce = startNonce;
-            // Increase start nonce for following kernel execution.
-            startNonce += m_settings.globalWorkSize;
+            currentNonces = noncesLeft;
+            // Move to the start nonce of the following kernel execution.
+            noncesLeft = nextNonces(w, startNonce, m_settings.globalWorkSize);
             // Report hash count
             if (m_settings.noExit)
                 updateHashRate(m_settings.globalWorkSize, 1);
@@ -460,7 +496,7 @@ void CLMiner::kick_miner()
         m_abortqueue[0].enqueueWriteBuffer(
             m_searchBuffer[0], CL_TRUE, offsetof(SearchResults, abort), sizeof(one), &one);
 
-    m_new_work_signal.notify_one();
+    wakeWork();
 }
 
 void CLMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection) 
@@ -897,35 +933,71 @@ bool CLMiner::initEpoch_internal()
         m_searchBuffer.clear();
         m_searchBuffer.emplace_back(m_context[0], CL_MEM_WRITE_ONLY, sizeof(SearchResults));
 
-        m_dagKernel.setArg(1, m_light[0]);
-        m_dagKernel.setArg(2, m_dag[0]);
-        m_dagKernel.setArg(3, (uint32_t)(m_epochContext.lightSize / 64));
-
-        const uint32_t workItems = m_dagItems * 2;  // GPU computes partial 512-bit DAG items.
-
-        uint32_t start;
-        const uint32_t chunk = 10000 * m_settings.localWorkSize;
-        for (start = 0; start <= workItems - chunk; start += chunk)
+        // A copy offloaded by the last standby, else a stored one
+        if (!m_hostDag.holds(m_epochContext))
+            m_hostDag.clear();
+        const uint8_t* loaded = m_hostDag.data.get();
+        DagStore* store = Farm::f().dagStore();
+        auto stored = store && !loaded ? store->open(DagStoreKind::Full,
+                                             m_epochContext.epochNumber, m_epochContext.dagSize) :
+                                         nullptr;
+        if (stored)
+            loaded = stored->data();
+        if (loaded)
         {
-            m_dagKernel.setArg(0, start);
-            m_queue[0].enqueueNDRangeKernel(
-                m_dagKernel, cl::NullRange, chunk, m_settings.localWorkSize);
-            m_queue[0].finish();
+            // Stream the DAG into the device buffer
+            for (uint64_t offset = 0; offset < m_epochContext.dagSize; offset += c_dagStoreChunk)
+            {
+                const size_t len =
+                    size_t(min<uint64_t>(c_dagStoreChunk, m_epochContext.dagSize - offset));
+                m_queue[0].enqueueWriteBuffer(m_dag[0], CL_TRUE, offset, len, loaded + offset);
+            }
         }
-        if (start < workItems)
+        else
         {
-            uint32_t groupsLeft = workItems - start;
-            groupsLeft = (groupsLeft + m_settings.localWorkSize - 1) / m_settings.localWorkSize;
-            m_dagKernel.setArg(0, start);
-            m_queue[0].enqueueNDRangeKernel(m_dagKernel, cl::NullRange,
-                groupsLeft * m_settings.localWorkSize, m_settings.localWorkSize);
-            m_queue[0].finish();
+            m_dagKernel.setArg(1, m_light[0]);
+            m_dagKernel.setArg(2, m_dag[0]);
+            m_dagKernel.setArg(3, (uint32_t)(m_epochContext.lightSize / 64));
+
+            const uint32_t workItems = m_dagItems * 2;  // GPU computes partial 512-bit DAG items.
+
+            uint32_t start;
+            const uint32_t chunk = 10000 * m_settings.localWorkSize;
+            for (start = 0; start <= workItems - chunk; start += chunk)
+            {
+                m_dagKernel.setArg(0, start);
+                m_queue[0].enqueueNDRangeKernel(
+                    m_dagKernel, cl::NullRange, chunk, m_settings.localWorkSize);
+                m_queue[0].finish();
+            }
+            if (start < workItems)
+            {
+                uint32_t groupsLeft = workItems - start;
+                groupsLeft = (groupsLeft + m_settings.localWorkSize - 1) / m_settings.localWorkSize;
+                m_dagKernel.setArg(0, start);
+                m_queue[0].enqueueNDRangeKernel(m_dagKernel, cl::NullRange,
+                    groupsLeft * m_settings.localWorkSize, m_settings.localWorkSize);
+                m_queue[0].finish();
+            }
         }
 
         auto dagTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startInit);
         cllog << dev::getFormattedMemory((double)m_epochContext.dagSize)
-              << " of DAG data generated in "
+              << " of DAG data "
+              << (stored ? "loaded" : loaded ? "uploaded from host memory" : "generated") << " in "
               << dagTime.count() << " ms.";
+
+        // Read the DAG back once for the next run
+        if (store && !loaded)
+            saveDAG(*store, [this](uint8_t* _data) {
+                for (uint64_t offset = 0; offset < m_epochContext.dagSize;
+                     offset += c_dagStoreChunk)
+                {
+                    const size_t len =
+                        size_t(min<uint64_t>(c_dagStoreChunk, m_epochContext.dagSize - offset));
+                    m_queue[0].enqueueReadBuffer(m_dag[0], CL_TRUE, offset, len, _data + offset);
+                }
+            });
     }
     catch (cl::Error const& err)
     {
@@ -946,3 +1018,38 @@ void CLMiner::clearDAG()
     m_light.clear();
     m_header.clear();
 }
+
+bool CLMiner::offloadDAG()
+{
+    if (!m_dag_inited)
+        return false;
+
+    if (!m_hostDag.holds(m_epochContext))
+    {
+        uint8_t* data = m_hostDag.allocate(m_epochContext.dagSize);
+        if (!data)
+        {
+            cwarn << "Not enough host memory to offload the DAG";
+            return false;
+        }
+        try
+        {
+            for (uint64_t offset = 0; offset < m_epochContext.dagSize; offset += c_dagStoreChunk)
+            {
+                const size_t len =
+                    size_t(min<uint64_t>(c_dagStoreChunk, m_epochContext.dagSize - offset));
+                m_queue[0].enqueueReadBuffer(m_dag[0], CL_TRUE, offset, len, data + offset);
+            }
+        }
+        catch (cl::Error const& err)
+        {
+            cwarn << ethCLErrorHelper("Offloading DAG failed", err);
+            m_hostDag.clear();
+            return false;
+        }
+        m_hostDag.epoch = m_epochContext.epochNumber;
+    }
+
+    clearDAG();
+    return true;
+}
@@ -56,6 +56,8 @@ protected:
 
     bool initEpoch_internal() override;
 
+    bool offloadDAG() override;
+
     void kick_miner() override;
 
 private:
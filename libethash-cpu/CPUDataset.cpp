@@ -0,0 +1,319 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <ethash/keccak.hpp>
+
+#include "CPUDataset.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+constexpr uint32_t c_fnvPrime = 0x01000193;
+constexpr uint32_t c_datasetParents = 256;
+constexpr uint32_t c_generationChunk = 4096;  // Items claimed at once by a generating thread
+
+inline uint32_t fnv1(uint32_t u, uint32_t v) noexcept
+{
+    return (u * c_fnvPrime) ^ v;
+}
+
+// Running state of one 512-bit half of a dataset item
+struct ItemState
+{
+    const ethash::hash512* const cache;
+    const uint32_t numCacheItems;
+    const uint32_t seed;
+    ethash::hash512 mix;
+
+    ItemState(const ethash::hash512* _cache, uint32_t _numCacheItems, uint32_t _index) noexcept
+      : cache(_cache), numCacheItems(_numCacheItems), seed(_index)
+    {
+        mix = cache[_index % numCacheItems];
+        mix.word32s[0] ^= seed;
+        mix = ethash::keccak512(mix);
+    }
+
+    void update(uint32_t _round) noexcept
+    {
+        const uint32_t t = fnv1(seed ^ _round, mix.word32s[_round % 16]);
+        const ethash::hash512& parent = cache[t % numCacheItems];
+        for (unsigned i = 0; i < 16; i++)
+            mix.word32s[i] = fnv1(mix.word32s[i], parent.word32s[i]);
+    }
+
+    ethash::hash512 final() noexcept { return ethash::keccak512(mix); }
+};
+
+}  // namespace
+
+
+mutex CPUDataset::s_mutex;
+map<int, shared_ptr<CPUDataset>> CPUDataset::s_current;
+map<int, shared_ptr<CPUDataset>> CPUDataset::s_next;
+map<int, shared_ptr<CPUDataset>> CPUDataset::s_light;
+
+
+CPUDataset::CPUDataset(const EpochContext& _ec, PageBackingEnum _pages, int _numaNode,
+    shared_ptr<const DagStore::Mapping> _stored, bool _light)
+  : m_epoch(_ec.epochNumber),
+    m_numaNode(_numaNode),
+    m_numItems(static_cast<uint32_t>(_ec.dagNumItems)),
+    m_lightNumItems(static_cast<uint32_t>(_ec.lightNumItems)),
+    m_items(nullptr),
+    m_isLight(_light)
+{
+    if (_light)
+    {
+        // Items are calculated by the searches: nothing to generate nor save
+        m_generationStart = chrono::steady_clock::now();
+        m_nextItem = m_itemsDone = m_numItems;
+        m_generationStarted = m_generationFinished = true;
+        m_saved = true;
+    }
+    else if (_stored && _pages == PageBackingEnum::Normal && _numaNode < 0)
+    {
+        // Pages come straight from the page cache: nothing to allocate
+        m_stored = _stored;
+        m_items = reinterpret_cast<ethash::hash1024*>(const_cast<uint8_t*>(m_stored->data()));
+    }
+    else
+    {
+        // Zeroed memory marks items as not yet calculated
+        m_itemsMemory.allocate(size(), _pages, _numaNode);
+        m_items = static_cast<ethash::hash1024*>(m_itemsMemory.data());
+        if (_stored)
+            memcpy(m_items, _stored->data(), size());
+    }
+
+    if (_stored)
+    {
+        // Nothing left to generate
+        m_fromStore = true;
+        m_generationStart = chrono::steady_clock::now();
+        m_nextItem = m_itemsDone = m_numItems;
+        m_generationStarted = m_generationFinished = true;
+        m_saved = true;
+    }
+
+    // The light cache is too small for 1 GiB pages
+    const size_t lightSize = m_lightNumItems * sizeof(ethash::hash512);
+    m_lightMemory.allocate(lightSize, std::min(_pages, PageBackingEnum::Huge2M), _numaNode);
+    m_light = static_cast<ethash::hash512*>(m_lightMemory.data());
+    memcpy(m_light, _ec.lightCache, lightSize);
+}
+
+
+shared_ptr<CPUDataset> CPUDataset::create(
+    const EpochContext& _ec, PageBackingEnum _pages, int _numaNode, DagStore* _store)
+{
+    shared_ptr<const DagStore::Mapping> stored;
+    if (_store)
+        stored = _store->open(DagStoreKind::Full, _ec.epochNumber,
+            uint64_t(_ec.dagNumItems) * sizeof(ethash::hash1024));
+
+    // The light cache is copied: the epoch context may not outlive this call
+    return shared_ptr<CPUDataset>(new CPUDataset(_ec, _pages, _numaNode, stored));
+}
+
+
+shared_ptr<CPUDataset> CPUDataset::get(
+    const EpochContext& _ec, PageBackingEnum _pages, int _numaNode, DagStore* _store)
+{
+    lock_guard<mutex> l(s_mutex);
+    shared_ptr<CPUDataset>& current = s_current[_numaNode];
+    if (current && current->epoch() == _ec.epochNumber)
+        return current;
+
+    // Release the previous epoch first: miners still holding it keep it alive
+    current.reset();
+
+    shared_ptr<CPUDataset>& next = s_next[_numaNode];
+    if (next && next->epoch() == _ec.epochNumber)
+        current.swap(next);
+    else
+        current = create(_ec, _pages, _numaNode, _store);
+    return current;
+}
+
+
+shared_ptr<CPUDataset> CPUDataset::light(
+    const EpochContext& _ec, PageBackingEnum _pages, int _numaNode)
+{
+    lock_guard<mutex> l(s_mutex);
+    shared_ptr<CPUDataset>& current = s_light[_numaNode];
+    if (current && current->epoch() == _ec.epochNumber)
+        return current;
+
+    current.reset();
+    current = shared_ptr<CPUDataset>(new CPUDataset(_ec, _pages, _numaNode, nullptr, true));
+    return current;
+}
+
+
+shared_ptr<CPUDataset> CPUDataset::prepare(
+    const EpochContext& _ec, PageBackingEnum _pages, int _numaNode, DagStore* _store)
+{
+    lock_guard<mutex> l(s_mutex);
+    shared_ptr<CPUDataset>& current = s_current[_numaNode];
+    if (current && current->epoch() == _ec.epochNumber)
+        return current;
+
+    shared_ptr<CPUDataset>& next = s_next[_numaNode];
+    if (next && next->epoch() == _ec.epochNumber)
+        return next;
+
+    next.reset();
+    next = create(_ec, _pages, _numaNode, _store);
+    return next;
+}
+
+
+bool CPUDataset::save(DagStore& _store)
+{
+    if (!m_generationFinished.load() || m_itemsDone.load() < m_numItems || m_saved.exchange(true))
+        return false;
+    return _store.save(DagStoreKind::Full, m_epoch, m_items, size());
+}
+
+
+bool CPUDataset::saveAsync(DagStore& _store)
+{
+    if (!m_generationFinished.load() || m_itemsDone.load() < m_numItems || m_saved.exchange(true))
+        return false;
+    return _store.saveAsync(DagStoreKind::Full, m_epoch,
+        shared_ptr<const void>(shared_from_this(), m_items), size());
+}
+
+
+ethash::hash1024 CPUDataset::calculateItem(uint32_t _index) const noexcept
+{
+    ItemState item0{m_light, m_lightNumItems, _index * 2};
+    ItemState item1{m_light, m_lightNumItems, _index * 2 + 1};
+
+    for (uint32_t j = 0; j < c_datasetParents; j++)
+    {
+        item0.update(j);
+        item1.update(j);
+    }
+
+    ethash::hash1024 r;
+    r.hash512s[0] = item0.final();
+    r.hash512s[1] = item1.final();
+    return r;
+}
+
+
+void CPUDataset::generate(unsigned _threads, const function<void(unsigned)>& _threadInit,
+    const function<void(const DagProgress&)>& _onProgress, const function<bool()>& _cancel)
+{
+    if (m_generationStarted.exchange(true))
+    {
+        // Somebody else is generating: maybe for minutes, so keep watching for cancellation
+        unique_lock<mutex> l(x_generation);
+        while (!m_generationSignal.wait_for(
+            l, chrono::milliseconds(100), [this] { return m_generationFinished.load(); }))
+        {
+            if (_cancel && _cancel())
+                return;
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> l(x_generation);
+        m_generationStart = chrono::steady_clock::now();
+    }
+    atomic<bool> cancelled = {false};
+
+    auto worker = [&](unsigned _ordinal) {
+        if (_threadInit)
+            _threadInit(_ordinal);
+        while (!cancelled.load(memory_order_relaxed))
+        {
+            const uint32_t begin = m_nextItem.fetch_add(c_generationChunk);
+            if (begin >= m_numItems)
+                break;
+            const uint32_t end = min(begin + c_generationChunk, m_numItems);
+            for (uint32_t i = begin; i < end; i++)
+                m_items[i] = calculateItem(i);
+            if (m_itemsDone.fetch_add(end - begin) + (end - begin) == m_numItems)
+                m_generationSignal.notify_all();
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned i = 0; i < max(_threads, 1u); i++)
+        threads.emplace_back(worker, i);
+
+    // This thread only reports progress and watches for cancellation
+    while (m_itemsDone.load(memory_order_relaxed) < m_numItems)
+    {
+        unique_lock<mutex> l(x_generation);
+        m_generationSignal.wait_for(l, chrono::seconds(2));
+        l.unlock();
+        if (_cancel && _cancel())
+        {
+            cancelled.store(true);
+            break;
+        }
+        if (_onProgress)
+            _onProgress(progress());
+    }
+
+    for (auto& t : threads)
+        t.join();
+
+    {
+        lock_guard<mutex> l(x_generation);
+        m_generationFinished.store(true);
+    }
+    m_generationSignal.notify_all();
+
+    if (_onProgress)
+        _onProgress(progress());
+}
+
+
+DagProgress CPUDataset::progress() const
+{
+    DagProgress p;
+    p.total = m_numItems;
+    p.finished = m_generationFinished.load();
+    if (!m_generationStarted.load())
+        return p;
+
+    chrono::steady_clock::time_point start;
+    {
+        lock_guard<mutex> l(x_generation);
+        start = m_generationStart;
+    }
+    p.done = min(m_itemsDone.load(memory_order_relaxed), m_numItems);
+    const double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (elapsed > 0.0)
+        p.itemsPerSecond = p.done / elapsed;
+    if (p.itemsPerSecond > 0.0)
+        p.etaSeconds = (p.total - p.done) / p.itemsPerSecond;
+    return p;
+}
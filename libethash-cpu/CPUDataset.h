@@ -0,0 +1,220 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Ethash full dataset (DAG) owned by the CPU backend.
+
+ ethash's own full context keeps its dataset private, so the CPU search
+ kernels work on this copy instead. Items are 1024 bits wide and are
+ generated up front by a team of threads. Like in ethash, an item not
+ yet generated is calculated from the light cache on first access.
+ With a DAG store a dataset saved by a previous run is loaded instead.
+
+ A light dataset holds the light cache only. It is searched with
+ searchLight(), which calculates the items it reads.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+#include <ethash/ethash.hpp>
+#include <libethcore/DagStore.h>
+
+#include "CPUKernels.h"
+#include "HugePages.h"
+
+namespace dev
+{
+namespace eth
+{
+struct DagProgress
+{
+    uint32_t done = 0;      // Items generated
+    uint32_t total = 0;     // Items in the dataset
+    double itemsPerSecond = 0.0;
+    double etaSeconds = 0.0;
+    bool finished = false;  // Generation ended (completed or cancelled)
+};
+
+class CPUDataset : public std::enable_shared_from_this<CPUDataset>
+{
+public:
+    CPUDataset(const CPUDataset&) = delete;
+    CPUDataset& operator=(const CPUDataset&) = delete;
+
+    /**
+     * @brief Returns the dataset for the given epoch
+     * With a negative _numaNode the dataset is shared by all CPU miners,
+     * otherwise each node gets its own replica placed in its local memory.
+     * Only the most recent epoch is kept alive by the cache. Memory is
+     * backed by pages no larger than _pages.
+     * If _store holds the dataset it is loaded complete: mapped read-only
+     * with normal pages outside NUMA mode, copied otherwise.
+     * Throws std::bad_alloc if the dataset can not be allocated.
+     */
+    static std::shared_ptr<CPUDataset> get(const EpochContext& _ec, PageBackingEnum _pages,
+        int _numaNode = -1, DagStore* _store = nullptr);
+
+    /**
+     * @brief Allocates ahead of time the dataset of an upcoming epoch
+     * The dataset is kept aside, next to the current one, until get()
+     * asks for its epoch. Arguments and exceptions are those of get().
+     */
+    static std::shared_ptr<CPUDataset> prepare(const EpochContext& _ec, PageBackingEnum _pages,
+        int _numaNode = -1, DagStore* _store = nullptr);
+
+    /**
+     * @brief Returns the light dataset for the given epoch
+     * Sharing is that of get(). Throws std::bad_alloc on allocation failure.
+     */
+    static std::shared_ptr<CPUDataset> light(
+        const EpochContext& _ec, PageBackingEnum _pages, int _numaNode = -1);
+
+    int epoch() const { return m_epoch; }
+    int numaNode() const { return m_numaNode; }
+    uint32_t numItems() const { return m_numItems; }
+    uint64_t size() const { return uint64_t(m_numItems) * sizeof(ethash::hash1024); }
+    PageBackingEnum backing() const { return m_itemsMemory.backing(); }
+    PageBackingEnum lightBacking() const { return m_lightMemory.backing(); }
+    bool fromStore() const { return m_fromStore; }
+    bool isLight() const { return m_isLight; }
+
+    /**
+     * @brief Bytes allocated: the items, unless light or mapped, and the light cache
+     */
+    uint64_t memory() const { return m_itemsMemory.size() + m_lightMemory.size(); }
+
+    /**
+     * @brief Generates all items with _threads threads
+     * Only the first caller generates, the others wait for it to finish.
+     * _threadInit is called first thing by every generating thread with
+     * its ordinal, _onProgress every two seconds and at the end by the
+     * calling thread. Generation stops early if _cancel returns true;
+     * remaining items are then calculated on first access. Waiters return
+     * early too, the generation going on.
+     */
+    void generate(unsigned _threads, const std::function<void(unsigned)>& _threadInit,
+        const std::function<void(const DagProgress&)>& _onProgress,
+        const std::function<bool()>& _cancel);
+
+    /**
+     * @brief Returns the current state of generation
+     */
+    DagProgress progress() const;
+
+    /**
+     * @brief Writes a completely generated dataset to _store
+     * Only the first call writes. Returns whether the dataset was written.
+     */
+    bool save(DagStore& _store);
+
+    /**
+     * @brief Same as save() on the writer thread of _store
+     * The dataset is kept alive till written. Returns whether it was queued.
+     */
+    bool saveAsync(DagStore& _store);
+
+    /**
+     * @brief Returns a dataset item, calculating it if not yet done
+     * Concurrent callers may calculate the same item twice: they store
+     * identical values, as in ethash's lazy lookup. Not for light datasets.
+     */
+    const ethash::hash1024& item(uint32_t _index) noexcept
+    {
+        ethash::hash1024& item = m_items[_index];
+        if (item.word64s[0] == 0 && !m_stored)
+            item = calculateItem(_index);
+        return item;
+    }
+
+    /**
+     * @brief Hints the CPU to bring an item (two cache lines) into cache
+     */
+    void prefetch(uint32_t _index) const noexcept
+    {
+        const char* p = reinterpret_cast<const char*>(&m_items[_index]);
+#if defined(_MSC_VER)
+        _mm_prefetch(p, _MM_HINT_T0);
+        _mm_prefetch(p + 64, _MM_HINT_T0);
+#else
+        __builtin_prefetch(p);
+        __builtin_prefetch(p + 64);
+#endif
+    }
+
+    /**
+     * @brief Describes the dataset to the hashing kernels
+     * Items are known to be complete once generation has finished them all.
+     */
+    KernelDataset kernelView() noexcept
+    {
+        return {m_items, m_numItems, !m_stored && m_itemsDone.load() < m_numItems, this};
+    }
+
+    /**
+     * @brief Calculates a dataset item from the light cache
+     */
+    ethash::hash1024 calculateItem(uint32_t _index) const noexcept;
+
+private:
+    CPUDataset(const EpochContext& _ec, PageBackingEnum _pages, int _numaNode,
+        std::shared_ptr<const DagStore::Mapping> _stored, bool _light = false);
+
+    static std::shared_ptr<CPUDataset> create(
+        const EpochContext& _ec, PageBackingEnum _pages, int _numaNode, DagStore* _store);
+
+    int m_epoch;
+    int m_numaNode;
+    uint32_t m_numItems;
+    uint32_t m_lightNumItems;
+    HugePageBuffer m_itemsMemory;
+    HugePageBuffer m_lightMemory;
+    ethash::hash1024* m_items;
+    ethash::hash512* m_light;
+    std::shared_ptr<const DagStore::Mapping> m_stored;  // When items are mapped read-only
+    bool m_fromStore = false;
+    bool m_isLight = false;
+    std::atomic<bool> m_saved = {false};
+
+    std::atomic<bool> m_generationStarted = {false};
+    std::atomic<bool> m_generationFinished = {false};
+    std::atomic<uint32_t> m_nextItem = {0};  // First item of next chunk to be claimed
+    std::atomic<uint32_t> m_itemsDone = {0};
+    std::chrono::steady_clock::time_point m_generationStart;
+    mutable std::mutex x_generation;
+    std::condition_variable m_generationSignal;
+
+    static std::mutex s_mutex;
+    static std::map<int, std::shared_ptr<CPUDataset>> s_current;  // By NUMA node
+    static std::map<int, std::shared_ptr<CPUDataset>> s_next;     // Prepared, by NUMA node
+    static std::map<int, std::shared_ptr<CPUDataset>> s_light;    // By NUMA node
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,249 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include <ethash/keccak.hpp>
+
+#include "CPUHashimoto.h"
+#include "CPUItemCache.h"
+#include "CPUKernels.h"
+#include "KeccakLanes.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+constexpr uint32_t c_fnvPrime = 0x01000193;
+
+inline uint32_t fnv1(uint32_t u, uint32_t v) noexcept
+{
+    return (u * c_fnvPrime) ^ v;
+}
+
+/*
+ * The ethash mixing loop: 64 dependent reads of 1024-bit dataset items,
+ * then compression of the 1024-bit mix down to 256 bits.
+ * _lookup(index) returns an item.
+ */
+template <class Lookup>
+ethash::hash256 mixKernel(
+    uint32_t _numItems, const ethash::hash512& _seed, Lookup&& _lookup) noexcept
+{
+    const uint32_t seedInit = _seed.word32s[0];
+
+    uint32_t mix[32];
+    for (unsigned i = 0; i < 32; i++)
+        mix[i] = _seed.word32s[i % 16];
+
+    for (uint32_t i = 0; i < ethash::num_dataset_accesses; i++)
+    {
+        const uint32_t p = fnv1(i ^ seedInit, mix[i % 32]) % _numItems;
+        const ethash::hash1024& item = _lookup(p);
+        for (unsigned j = 0; j < 32; j++)
+            mix[j] = fnv1(mix[j], item.word32s[j]);
+    }
+
+    ethash::hash256 mixHash;
+    for (unsigned i = 0; i < 32; i += 4)
+        mixHash.word32s[i / 4] = fnv1(fnv1(fnv1(mix[i], mix[i + 1]), mix[i + 2]), mix[i + 3]);
+    return mixHash;
+}
+
+ethash::hash512 seedHash(const ethash::hash256& _header, uint64_t _nonce) noexcept
+{
+    uint8_t seedData[sizeof(_header) + sizeof(_nonce)];
+    memcpy(&seedData[0], _header.bytes, sizeof(_header));
+    memcpy(&seedData[sizeof(_header)], &_nonce, sizeof(_nonce));
+    return ethash::keccak512(seedData, sizeof(seedData));
+}
+
+ethash::hash256 finalHash(const ethash::hash512& _seed, const ethash::hash256& _mixHash) noexcept
+{
+    uint8_t finalData[sizeof(_seed) + sizeof(_mixHash)];
+    memcpy(&finalData[0], _seed.bytes, sizeof(_seed));
+    memcpy(&finalData[sizeof(_seed)], _mixHash.bytes, sizeof(_mixHash));
+    return ethash::keccak256(finalData, sizeof(finalData));
+}
+
+inline bool isLessOrEqual(const ethash::hash256& _a, const ethash::hash256& _b) noexcept
+{
+    for (size_t i = 0; i < sizeof(_a); i++)
+        if (_a.bytes[i] != _b.bytes[i])
+            return _a.bytes[i] < _b.bytes[i];
+    return true;
+}
+
+}  // namespace
+
+
+ethash::result dev::eth::hashimoto(
+    CPUDataset& _dataset, const ethash::hash256& _header, uint64_t _nonce) noexcept
+{
+    const ethash::hash512 seed = seedHash(_header, _nonce);
+    const ethash::hash256 mixHash = mixKernel(_dataset.numItems(), seed,
+        [&_dataset](uint32_t _index) -> const ethash::hash1024& { return _dataset.item(_index); });
+
+    ethash::result r;
+    r.final_hash = finalHash(seed, mixHash);
+    r.mix_hash = mixHash;
+    return r;
+}
+
+
+ethash::search_result dev::eth::searchScalar(CPUDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations) noexcept
+{
+    for (uint64_t nonce = _startNonce; nonce < _startNonce + _iterations; nonce++)
+    {
+        const ethash::result r = hashimoto(_dataset, _header, nonce);
+        if (isLessOrEqual(r.final_hash, _boundary))
+            return {r, nonce};
+    }
+    return {};
+}
+
+
+ethash::search_result dev::eth::searchLight(const CPUDataset& _dataset, CPUItemCache& _cache,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _iterations) noexcept
+{
+    auto lookup = [&_dataset, &_cache](uint32_t _index) -> const ethash::hash1024& {
+        return _cache.item(_dataset, _index);
+    };
+    for (uint64_t nonce = _startNonce; nonce < _startNonce + _iterations; nonce++)
+    {
+        const ethash::hash512 seed = seedHash(_header, nonce);
+        const ethash::hash256 mixHash = mixKernel(_dataset.numItems(), seed, lookup);
+        const ethash::hash256 final = finalHash(seed, mixHash);
+        if (isLessOrEqual(final, _boundary))
+        {
+            ethash::result r;
+            r.final_hash = final;
+            r.mix_hash = mixHash;
+            return {r, nonce};
+        }
+    }
+    return {};
+}
+
+
+namespace
+{
+ethash::search_result toSearchResult(bool _found, const KernelSolution& _solution) noexcept
+{
+    if (!_found)
+        return {};
+    ethash::result r;
+    r.final_hash = _solution.finalHash;
+    r.mix_hash = _solution.mixHash;
+    return {r, _solution.nonce};
+}
+
+}  // namespace
+
+
+ethash::search_result dev::eth::searchLanes(CPUDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations) noexcept
+{
+    KernelSolution s;
+    const bool found = activeCPUKernel().searchLanes(
+        _dataset.kernelView(), _header, _boundary, _startNonce, _iterations, s);
+    return toSearchResult(found, s);
+}
+
+
+ethash::search_result dev::eth::searchInterleaved(CPUDataset& _dataset,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _iterations, unsigned _lanes) noexcept
+{
+    KernelSolution s;
+    const bool found = activeCPUKernel().searchInterleaved(
+        _dataset.kernelView(), _header, _boundary, _startNonce, _iterations, _lanes, s);
+    return toSearchResult(found, s);
+}
+
+
+bool dev::eth::verifyLanes(CPUDataset& _dataset, const ethash::epoch_context& _light) noexcept
+{
+    const ethash::hash256 header = ethash::calculate_epoch_seed(_dataset.epoch() + 1);
+    const size_t lanes = keccakLanes();
+    uint64_t nonces[c_maxKeccakLanes];
+    ethash::hash512 seeds[c_maxKeccakLanes];
+    ethash::hash256 mixes[c_maxKeccakLanes];
+    ethash::hash256 finals[c_maxKeccakLanes];
+
+    for (size_t l = 0; l < lanes; l++)
+    {
+        nonces[l] = header.word64s[1] + l * 0x9e3779b97f4a7c15;
+        mixes[l] = ethash::calculate_epoch_seed(int(l));
+    }
+
+    // Every lane of both Keccak kernels against the scalar Keccak
+    keccak512HeaderNonce(header, nonces, seeds);
+    keccak256Final(seeds, mixes, finals);
+    for (size_t l = 0; l < lanes; l++)
+    {
+        uint8_t seedData[sizeof(header) + sizeof(uint64_t)];
+        memcpy(&seedData[0], header.bytes, sizeof(header));
+        memcpy(&seedData[sizeof(header)], &nonces[l], sizeof(uint64_t));
+        const ethash::hash512 seed = ethash::keccak512(seedData, sizeof(seedData));
+
+        uint8_t finalData[sizeof(seed) + sizeof(ethash::hash256)];
+        memcpy(&finalData[0], seeds[l].bytes, sizeof(seed));
+        memcpy(&finalData[sizeof(seed)], mixes[l].bytes, sizeof(ethash::hash256));
+        const ethash::hash256 final = ethash::keccak256(finalData, sizeof(finalData));
+
+        if (memcmp(seed.bytes, seeds[l].bytes, sizeof(seed)) != 0 ||
+            memcmp(final.bytes, finals[l].bytes, sizeof(final)) != 0)
+            return false;
+    }
+
+    // Whole hashimoto against ethash's light evaluation
+    ethash::hash256 boundary;
+    memset(boundary.bytes, 0xff, sizeof(boundary));
+    const auto expected = ethash::hash(_light, header, nonces[0]);
+    const ethash::search_result results[] = {
+        searchLanes(_dataset, header, boundary, nonces[0], 1),
+        searchInterleaved(_dataset, header, boundary, nonces[0], 1, c_maxInterleave)};
+    for (const auto& r : results)
+    {
+        if (!r.solution_found || r.nonce != nonces[0] ||
+            memcmp(r.final_hash.bytes, expected.final_hash.bytes, sizeof(r.final_hash)) != 0 ||
+            memcmp(r.mix_hash.bytes, expected.mix_hash.bytes, sizeof(r.mix_hash)) != 0)
+            return false;
+    }
+
+    // The searches reject on the leading 64 bits first: a boundary equal
+    // to the hash must be met, one just below it must not
+    auto meets = [&](const ethash::hash256& _boundary) {
+        const bool lanes = searchLanes(_dataset, header, _boundary, nonces[0], 1).solution_found;
+        const bool interleaved =
+            searchInterleaved(_dataset, header, _boundary, nonces[0], 1, c_maxInterleave)
+                .solution_found;
+        return lanes == interleaved ? int(lanes) : -1;
+    };
+    boundary = expected.final_hash;
+    if (meets(boundary) != 1)
+        return false;
+    for (int i = sizeof(boundary) - 1; i >= 0; i--)
+        if (boundary.bytes[i]-- != 0)
+            break;
+    return meets(boundary) == 0;
+}
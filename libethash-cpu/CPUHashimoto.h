@@ -0,0 +1,81 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <ethash/ethash.hpp>
+
+#include "CPUDataset.h"
+
+namespace dev
+{
+namespace eth
+{
+class CPUItemCache;
+
+/**
+ * @brief Ethash hash of a single nonce (scalar reference path)
+ */
+ethash::result hashimoto(
+    CPUDataset& _dataset, const ethash::hash256& _header, uint64_t _nonce) noexcept;
+
+/**
+ * @brief Searches nonces one at a time with hashimoto(), as ethash::search() does
+ * For when the lane kernels fail verifyLanes(): slow but Keccak is ethash's.
+ */
+ethash::search_result searchScalar(CPUDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations) noexcept;
+
+/**
+ * @brief Searches nonces of a light dataset, as ethash::search_light() does
+ * Items are taken from _cache, calculated from the light cache on a miss.
+ * Works with any dataset but is meant for light ones.
+ */
+ethash::search_result searchLight(const CPUDataset& _dataset, CPUItemCache& _cache,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _startNonce,
+    size_t _iterations) noexcept;
+
+/**
+ * @brief Searches [_startNonce, _startNonce + _iterations) for a solution
+ * Nonces are hashed keccakLanes() at a time by the active kernel variant.
+ * Returns the lowest nonce satisfying the boundary, exactly as
+ * ethash::search() does. Final hashes are first compared on their leading
+ * 64 bits, only the few candidates are compared in full.
+ */
+ethash::search_result searchLanes(CPUDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations) noexcept;
+
+/**
+ * @brief Same as searchLanes() with _lanes nonces mixed in lockstep
+ * Every round the next DAG item of each lane is prefetched before any
+ * lane is mixed, so that up to _lanes memory reads are in flight
+ * instead of one. _lanes must be in [1, c_maxInterleave].
+ */
+ethash::search_result searchInterleaved(CPUDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations,
+    unsigned _lanes) noexcept;
+
+/**
+ * @brief Cross checks the active lane kernels against ethash
+ * Every Keccak lane is compared with ethash's scalar Keccak and one full
+ * hash of both search paths with ethash's light evaluation, including
+ * boundaries on either side of the hash.
+ */
+bool verifyLanes(CPUDataset& _dataset, const ethash::epoch_context& _light) noexcept;
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,86 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "CPUDataset.h"
+#include "CPUItemCache.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+
+CPUItemCache::CPUItemCache(size_t _bytes)
+{
+    // Any number of sets: a division is nothing next to calculating an item
+    const size_t perSet = 2 * (sizeof(ethash::hash1024) + sizeof(uint32_t)) + sizeof(uint8_t);
+    const size_t sets = std::min<size_t>(_bytes / perSet, uint32_t(1) << 30);
+    if (!sets)
+        return;  // Too small to cache anything
+
+    m_items.resize(sets * 2);
+    m_tags.assign(sets * 2, 0);
+    m_lru.assign(sets, 0);
+    m_numSets = uint32_t(sets);
+    m_memory = sets * perSet;
+}
+
+
+void CPUItemCache::clear() noexcept
+{
+    fill(m_tags.begin(), m_tags.end(), 0);
+    fill(m_lru.begin(), m_lru.end(), 0);
+}
+
+
+const ethash::hash1024& CPUItemCache::item(const CPUDataset& _dataset, uint32_t _index) noexcept
+{
+    if (m_tags.empty())
+    {
+        m_misses.store(m_misses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        m_uncached = _dataset.calculateItem(_index);
+        return m_uncached;
+    }
+
+    if (_dataset.epoch() != m_epoch)
+    {
+        clear();
+        m_epoch = _dataset.epoch();
+    }
+
+    const uint32_t set = _index % m_numSets;
+    const uint32_t tag = _index + 1;
+    uint32_t* tags = &m_tags[set * 2];
+    for (unsigned way = 0; way < 2; way++)
+    {
+        if (tags[way] == tag)
+        {
+            m_lru[set] = uint8_t(way ^ 1);
+            m_hits.store(m_hits.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            return m_items[set * 2 + way];
+        }
+    }
+
+    // Only this thread updates the counters: no need for a locked add
+    m_misses.store(m_misses.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    const unsigned way = m_lru[set];
+    m_items[set * 2 + way] = _dataset.calculateItem(_index);
+    tags[way] = tag;
+    m_lru[set] = uint8_t(way ^ 1);
+    return m_items[set * 2 + way];
+}
@@ -0,0 +1,91 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Bounded cache of calculated dataset items for light mode.
+
+ The 64 items a hash reads are spread uniformly over the dataset, so a
+ cache of a given fraction of the dataset hits roughly as often. It is
+ 2-way set-associative: an item may be in either way of the set its
+ index maps to, and a miss evicts the least recently used way. One cache
+ per hashing thread, no locking.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <ethash/hash_types.hpp>
+
+namespace dev
+{
+namespace eth
+{
+class CPUDataset;
+
+class CPUItemCache
+{
+public:
+    /**
+     * @brief Creates a cache of at most _bytes
+     * Below the size of one set (two items) nothing is cached.
+     */
+    explicit CPUItemCache(size_t _bytes);
+
+    CPUItemCache(const CPUItemCache&) = delete;
+    CPUItemCache& operator=(const CPUItemCache&) = delete;
+
+    /**
+     * @brief Returns an item of _dataset, calculating it on a miss
+     * The cache empties itself when the epoch of _dataset changes.
+     * The reference is valid until the next call.
+     */
+    const ethash::hash1024& item(const CPUDataset& _dataset, uint32_t _index) noexcept;
+
+    /**
+     * @brief Bytes allocated by the cache
+     */
+    size_t memory() const { return m_memory; }
+
+    /**
+     * @brief Number of items the cache holds when full
+     */
+    size_t capacity() const { return m_items.size(); }
+
+    // Read by other threads
+    uint64_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+private:
+    void clear() noexcept;
+
+    std::vector<ethash::hash1024> m_items;  // Both ways of set i at 2i and 2i + 1
+    std::vector<uint32_t> m_tags;           // Item index + 1 of each way, 0 if empty
+    std::vector<uint8_t> m_lru;             // Least recently used way of each set
+    uint32_t m_numSets = 0;
+    size_t m_memory = 0;
+    int m_epoch = -1;
+    ethash::hash1024 m_uncached;  // Last item calculated without a cache
+
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,195 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include <libethcore/Miner.h>
+
+#include "CPUDataset.h"
+#include "CPUKernels.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ETH_CPUID 1
+
+bool cpuid(unsigned _leaf, unsigned _subleaf, unsigned _regs[4])
+{
+    int regs[4];
+    __cpuid(regs, 0);
+    if (unsigned(regs[0]) < _leaf)
+        return false;
+    __cpuidex(regs, int(_leaf), int(_subleaf));
+    for (unsigned i = 0; i < 4; i++)
+        _regs[i] = unsigned(regs[i]);
+    return true;
+}
+
+uint64_t xgetbv0()
+{
+    return _xgetbv(0);
+}
+
+#elif defined(__x86_64__) || defined(__i386__)
+#define ETH_CPUID 1
+
+bool cpuid(unsigned _leaf, unsigned _subleaf, unsigned _regs[4])
+{
+    if (__get_cpuid_max(0, nullptr) < _leaf)
+        return false;
+    __cpuid_count(_leaf, _subleaf, _regs[0], _regs[1], _regs[2], _regs[3]);
+    return true;
+}
+
+uint64_t xgetbv0()
+{
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+}
+
+#endif
+
+CPUFeatures detectFeatures()
+{
+    CPUFeatures f;
+#if defined(ETH_CPUID)
+    unsigned regs[4];  // eax, ebx, ecx, edx
+    if (!cpuid(1, 0, regs))
+        return f;
+    f.sse41 = regs[2] & (1u << 19);
+
+    // AVX state must also be enabled by the OS (XCR0: XMM and YMM)
+    const bool osxsave = regs[2] & (1u << 27);
+    const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    f.avx = (regs[2] & (1u << 28)) && (xcr0 & 0x06) == 0x06;
+
+    if (!cpuid(7, 0, regs))
+        return f;
+    f.avx2 = f.avx && (regs[1] & (1u << 5));
+    f.bmi2 = regs[1] & (1u << 8);
+    // ... and for AVX-512 the opmask and ZMM states
+    f.avx512f = f.avx && (regs[1] & (1u << 16)) && (xcr0 & 0xe0) == 0xe0;
+#endif
+    return f;
+}
+
+bool hostSupports(CPUKernelEnum _kernel)
+{
+    const CPUFeatures& f = cpuFeatures();
+    switch (_kernel)
+    {
+    case CPUKernelEnum::SSE41:
+        return f.sse41;
+    case CPUKernelEnum::AVX2:
+        return f.avx2 && f.bmi2;
+    case CPUKernelEnum::AVX512:
+        return f.avx512f && f.avx2 && f.bmi2;
+    default:
+        return true;
+    }
+}
+
+const CPUKernel& kernelOf(CPUKernelEnum _kernel)
+{
+    switch (_kernel)
+    {
+    case CPUKernelEnum::SSE41:
+        return c_kernelSSE41;
+    case CPUKernelEnum::AVX2:
+        return c_kernelAVX2;
+    case CPUKernelEnum::AVX512:
+        return c_kernelAVX512;
+    default:
+        return c_kernelGeneric;
+    }
+}
+
+atomic<const CPUKernel*>& active()
+{
+    static atomic<const CPUKernel*> s_active = {&cpuKernel(CPUKernelEnum::Auto)};
+    return s_active;
+}
+
+}  // namespace
+
+
+string CPUFeatures::str() const
+{
+    string s;
+    for (auto f : {make_pair(sse41, "sse4.1"), make_pair(avx, "avx"), make_pair(avx2, "avx2"),
+             make_pair(bmi2, "bmi2"), make_pair(avx512f, "avx512f")})
+        if (f.first)
+            s.append(s.empty() ? "" : " ").append(f.second);
+    return s.empty() ? "none" : s;
+}
+
+
+const CPUFeatures& dev::eth::cpuFeatures() noexcept
+{
+    static const CPUFeatures s_features = detectFeatures();
+    return s_features;
+}
+
+
+bool dev::eth::isCPUKernelUsable(CPUKernelEnum _kernel) noexcept
+{
+    return kernelOf(_kernel).compiled && hostSupports(_kernel);
+}
+
+
+const CPUKernel& dev::eth::cpuKernel(CPUKernelEnum _kernel) noexcept
+{
+    if (_kernel != CPUKernelEnum::Auto)
+        return kernelOf(_kernel);
+
+    for (auto k : {CPUKernelEnum::AVX512, CPUKernelEnum::AVX2, CPUKernelEnum::SSE41})
+        if (isCPUKernelUsable(k))
+            return kernelOf(k);
+    return c_kernelGeneric;
+}
+
+
+bool dev::eth::selectCPUKernel(CPUKernelEnum _kernel) noexcept
+{
+    if (!isCPUKernelUsable(_kernel))
+        return false;
+    active().store(&cpuKernel(_kernel));
+    return true;
+}
+
+
+const CPUKernel& dev::eth::activeCPUKernel() noexcept
+{
+    return *active().load(memory_order_relaxed);
+}
+
+
+ethash::hash1024 dev::eth::calculateKernelItem(const CPUDataset& _dataset, uint32_t _index) noexcept
+{
+    return _dataset.calculateItem(_index);
+}
@@ -0,0 +1,148 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Runtime dispatch of the CPU hashing kernels.
+
+ The lane kernels (Keccak and the search loops) are compiled once per
+ instruction set, each in its own translation unit built with the
+ matching compiler flags: CPUKernelsGeneric.cpp, CPUKernelsSSE41.cpp,
+ CPUKernelsAVX2.cpp and CPUKernelsAVX512.cpp. At startup the best
+ variant the host supports, as reported by cpuid, becomes the active
+ one. --cp-kernel overrides the choice.
+
+ Code built for one instruction set must never run on a host lacking
+ it. Variants thus share no inline code with the rest of the library:
+ they get at the dataset through KernelDataset and hand back plain
+ KernelSolution structures.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <ethash/hash_types.hpp>
+
+namespace dev
+{
+namespace eth
+{
+class CPUDataset;
+enum class CPUKernelEnum;  // Miner.h
+
+/**
+ * @brief Maximum number of nonces hashed in lockstep by searchInterleaved()
+ */
+constexpr unsigned c_maxInterleave = 16;
+
+/**
+ * @brief What a kernel needs to know of a CPUDataset
+ */
+struct KernelDataset
+{
+    ethash::hash1024* items;
+    uint32_t numItems;
+    bool lazy;            // Some items may not be generated yet
+    CPUDataset* dataset;  // Calculates missing items
+};
+
+/**
+ * @brief Out of line CPUDataset::calculateItem() for the kernels
+ */
+ethash::hash1024 calculateKernelItem(const CPUDataset& _dataset, uint32_t _index) noexcept;
+
+struct KernelSolution
+{
+    uint64_t nonce;
+    ethash::hash256 finalHash;
+    ethash::hash256 mixHash;
+};
+
+/**
+ * @brief Entry points of one kernel variant
+ */
+struct CPUKernel
+{
+    const char* name;  // Instruction set and lane count, e.g. "AVX2 x4"
+    size_t lanes;      // Nonces per Keccak call
+    bool compiled;     // False if the compiler could not target the instruction set
+
+    void (*keccak512HeaderNonce)(
+        const ethash::hash256& _header, const uint64_t* _nonces, ethash::hash512* _out);
+    void (*keccak256Final)(
+        const ethash::hash512* _seeds, const ethash::hash256* _mixes, ethash::hash256* _out);
+
+    // Both return whether a solution was found and fill _solution if so
+    bool (*searchLanes)(const KernelDataset& _dataset, const ethash::hash256& _header,
+        const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations,
+        KernelSolution& _solution);
+    bool (*searchInterleaved)(const KernelDataset& _dataset, const ethash::hash256& _header,
+        const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations,
+        unsigned _lanes, KernelSolution& _solution);
+};
+
+// One per translation unit
+extern const CPUKernel c_kernelGeneric;
+extern const CPUKernel c_kernelSSE41;
+extern const CPUKernel c_kernelAVX2;
+extern const CPUKernel c_kernelAVX512;
+
+/**
+ * @brief Instruction set extensions of the host relevant to the kernels
+ */
+struct CPUFeatures
+{
+    bool sse41 = false;
+    bool avx = false;      // Including OS support of the YMM state
+    bool avx2 = false;
+    bool bmi2 = false;
+    bool avx512f = false;  // Including OS support of the ZMM state
+
+    std::string str() const;
+};
+
+/**
+ * @brief Features of the host, detected once with cpuid
+ */
+const CPUFeatures& cpuFeatures() noexcept;
+
+/**
+ * @brief Returns the variant for an instruction set (Auto is the best usable one)
+ */
+const CPUKernel& cpuKernel(CPUKernelEnum _kernel) noexcept;
+
+/**
+ * @brief Whether a variant is compiled in and the host can run it
+ */
+bool isCPUKernelUsable(CPUKernelEnum _kernel) noexcept;
+
+/**
+ * @brief Makes a variant the active one
+ * Returns false, leaving the active variant unchanged, if it is not usable.
+ * Meant to be called once, before mining starts.
+ */
+bool selectCPUKernel(CPUKernelEnum _kernel) noexcept;
+
+/**
+ * @brief The variant in use by the search functions
+ */
+const CPUKernel& activeCPUKernel() noexcept;
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,23 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Hashing kernels for the baseline target of the build
+
+#include "CPUKernelsImpl.h"
+
+const dev::eth::CPUKernel dev::eth::c_kernelGeneric = {"generic x4", c_lanes, true,
+    &keccak512HeaderNonce, &keccak256Final, &searchLanes, &searchInterleaved};
@@ -0,0 +1,480 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Body of the hashing kernels, included once by each CPUKernels<ISA>.cpp.
+
+ Everything here has internal linkage so that every variant gets its own
+ copy, compiled with its own flags. The including file picks the vector
+ primitives by defining CPU_KERNEL_LANES_AVX512 or CPU_KERNEL_LANES_AVX2
+ (portable lanes otherwise) and exports the functions in a CPUKernel.
+
+ Keccak states are stored lane-interleaved: word i of lane l lives at
+ state[i * c_lanes + l], so that a SIMD register holds the same word of
+ all lanes.
+*/
+
+#pragma once
+
+#include <cstdlib>
+
+#if defined(CPU_KERNEL_LANES_AVX512) || defined(CPU_KERNEL_LANES_AVX2)
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+#include "CPUKernels.h"
+
+namespace
+{
+using namespace dev::eth;
+
+constexpr uint64_t c_roundConstants[24] = {0x0000000000000001, 0x0000000000008082,
+    0x800000000000808a, 0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
+    0x8000000080008081, 0x8000000000008009, 0x000000000000008a, 0x0000000000000088,
+    0x0000000080008009, 0x000000008000000a, 0x000000008000808b, 0x800000000000008b,
+    0x8000000000008089, 0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+    0x000000000000800a, 0x800000008000000a, 0x8000000080008081, 0x8000000000008080,
+    0x0000000080000001, 0x8000000080008008};
+
+constexpr unsigned c_rotations[24] = {
+    1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44};
+
+constexpr unsigned c_piLanes[24] = {
+    10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1};
+
+// Vector primitives. Every implementation provides load/store of one
+// interleaved word, xor, andnot (~a & b), rotate left and broadcast.
+
+#if defined(CPU_KERNEL_LANES_AVX512)
+
+constexpr size_t c_lanes = 8;
+using Lane = __m512i;
+
+inline Lane lload(const uint64_t* p) { return _mm512_loadu_si512(p); }
+inline void lstore(uint64_t* p, Lane v) { _mm512_storeu_si512(p, v); }
+inline Lane lxor(Lane a, Lane b) { return _mm512_xor_si512(a, b); }
+inline Lane landn(Lane a, Lane b) { return _mm512_andnot_si512(a, b); }
+inline Lane lrol(Lane a, unsigned n) { return _mm512_rolv_epi64(a, _mm512_set1_epi64(n)); }
+inline Lane lset1(uint64_t c) { return _mm512_set1_epi64(static_cast<long long>(c)); }
+
+#elif defined(CPU_KERNEL_LANES_AVX2)
+
+constexpr size_t c_lanes = 4;
+using Lane = __m256i;
+
+inline Lane lload(const uint64_t* p) { return _mm256_loadu_si256(reinterpret_cast<const Lane*>(p)); }
+inline void lstore(uint64_t* p, Lane v) { _mm256_storeu_si256(reinterpret_cast<Lane*>(p), v); }
+inline Lane lxor(Lane a, Lane b) { return _mm256_xor_si256(a, b); }
+inline Lane landn(Lane a, Lane b) { return _mm256_andnot_si256(a, b); }
+inline Lane lrol(Lane a, unsigned n)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(a, n), _mm256_srli_epi64(a, 64 - n));
+}
+inline Lane lset1(uint64_t c) { return _mm256_set1_epi64x(static_cast<long long>(c)); }
+
+#else
+
+// Portable lanes: plain arrays the compiler is free to vectorize
+constexpr size_t c_lanes = 4;
+
+struct Lane
+{
+    uint64_t w[c_lanes];
+};
+
+inline Lane lload(const uint64_t* p)
+{
+    Lane r;
+    for (size_t l = 0; l < c_lanes; l++)
+        r.w[l] = p[l];
+    return r;
+}
+inline void lstore(uint64_t* p, const Lane& v)
+{
+    for (size_t l = 0; l < c_lanes; l++)
+        p[l] = v.w[l];
+}
+inline Lane lxor(const Lane& a, const Lane& b)
+{
+    Lane r;
+    for (size_t l = 0; l < c_lanes; l++)
+        r.w[l] = a.w[l] ^ b.w[l];
+    return r;
+}
+inline Lane landn(const Lane& a, const Lane& b)
+{
+    Lane r;
+    for (size_t l = 0; l < c_lanes; l++)
+        r.w[l] = ~a.w[l] & b.w[l];
+    return r;
+}
+inline Lane lrol(const Lane& a, unsigned n)
+{
+    Lane r;
+    for (size_t l = 0; l < c_lanes; l++)
+        r.w[l] = (a.w[l] << n) | (a.w[l] >> (64 - n));
+    return r;
+}
+inline Lane lset1(uint64_t c)
+{
+    Lane r;
+    for (size_t l = 0; l < c_lanes; l++)
+        r.w[l] = c;
+    return r;
+}
+
+#endif
+
+static_assert(c_maxInterleave % c_lanes == 0, "Interleave must fit Keccak lanes");
+
+void keccakf1600(Lane st[25]) noexcept
+{
+    Lane bc[5];
+
+    for (unsigned round = 0; round < 24; round++)
+    {
+        // Theta
+        for (unsigned i = 0; i < 5; i++)
+            bc[i] = lxor(lxor(lxor(st[i], st[i + 5]), lxor(st[i + 10], st[i + 15])), st[i + 20]);
+
+        for (unsigned i = 0; i < 5; i++)
+        {
+            Lane t = lxor(bc[(i + 4) % 5], lrol(bc[(i + 1) % 5], 1));
+            for (unsigned j = 0; j < 25; j += 5)
+                st[j + i] = lxor(st[j + i], t);
+        }
+
+        // Rho Pi
+        Lane t = st[1];
+        for (unsigned i = 0; i < 24; i++)
+        {
+            unsigned j = c_piLanes[i];
+            bc[0] = st[j];
+            st[j] = lrol(t, c_rotations[i]);
+            t = bc[0];
+        }
+
+        // Chi
+        for (unsigned j = 0; j < 25; j += 5)
+        {
+            for (unsigned i = 0; i < 5; i++)
+                bc[i] = st[j + i];
+            for (unsigned i = 0; i < 5; i++)
+                st[j + i] = lxor(st[j + i], landn(bc[(i + 1) % 5], bc[(i + 2) % 5]));
+        }
+
+        // Iota
+        st[0] = lxor(st[0], lset1(c_roundConstants[round]));
+    }
+}
+
+void keccakf1600Lanes(uint64_t* _state) noexcept
+{
+    Lane st[25];
+    for (unsigned i = 0; i < 25; i++)
+        st[i] = lload(&_state[i * c_lanes]);
+    keccakf1600(st);
+    for (unsigned i = 0; i < 25; i++)
+        lstore(&_state[i * c_lanes], st[i]);
+}
+
+/*
+ * Keccak-512 has a rate of 72 bytes (9 words) so the 40 bytes of
+ * header and nonce fit one block. Padding bytes land in words 5 and 8.
+ * Assumes a little-endian host, as does ethash.
+ */
+void keccak512HeaderNonce(
+    const ethash::hash256& _header, const uint64_t* _nonces, ethash::hash512* _out)
+{
+    alignas(64) uint64_t state[25 * c_lanes] = {};
+
+    for (size_t l = 0; l < c_lanes; l++)
+    {
+        for (unsigned i = 0; i < 4; i++)
+            state[i * c_lanes + l] = _header.word64s[i];
+        state[4 * c_lanes + l] = _nonces[l];
+        state[5 * c_lanes + l] = 0x01;
+        state[8 * c_lanes + l] = 0x8000000000000000;
+    }
+
+    keccakf1600Lanes(state);
+
+    for (size_t l = 0; l < c_lanes; l++)
+        for (unsigned i = 0; i < 8; i++)
+            _out[l].word64s[i] = state[i * c_lanes + l];
+}
+
+/*
+ * Keccak-256 has a rate of 136 bytes (17 words) so the 96 bytes of
+ * seed and mix fit one block. Padding bytes land in words 12 and 16.
+ * Leaves the hashes in the first 4 words of _state.
+ */
+void keccak256FinalState(
+    const ethash::hash512* _seeds, const ethash::hash256* _mixes, uint64_t* _state)
+{
+    for (size_t i = 0; i < 25 * c_lanes; i++)
+        _state[i] = 0;
+
+    for (size_t l = 0; l < c_lanes; l++)
+    {
+        for (unsigned i = 0; i < 8; i++)
+            _state[i * c_lanes + l] = _seeds[l].word64s[i];
+        for (unsigned i = 0; i < 4; i++)
+            _state[(8 + i) * c_lanes + l] = _mixes[l].word64s[i];
+        _state[12 * c_lanes + l] = 0x01;
+        _state[16 * c_lanes + l] = 0x8000000000000000;
+    }
+
+    keccakf1600Lanes(_state);
+}
+
+void keccak256Final(
+    const ethash::hash512* _seeds, const ethash::hash256* _mixes, ethash::hash256* _out)
+{
+    alignas(64) uint64_t state[25 * c_lanes];
+    keccak256FinalState(_seeds, _mixes, state);
+
+    for (size_t l = 0; l < c_lanes; l++)
+        for (unsigned i = 0; i < 4; i++)
+            _out[l].word64s[i] = state[i * c_lanes + l];
+}
+
+constexpr uint32_t c_fnvPrime = 0x01000193;
+constexpr uint32_t c_datasetAccesses = 64;
+
+inline uint32_t fnv1(uint32_t u, uint32_t v) noexcept
+{
+    return (u * c_fnvPrime) ^ v;
+}
+
+inline size_t minSize(size_t a, size_t b) noexcept
+{
+    return a < b ? a : b;
+}
+
+inline uint64_t bswap64(uint64_t x) noexcept
+{
+#if defined(_MSC_VER)
+    return _byteswap_uint64(x);
+#else
+    return __builtin_bswap64(x);
+#endif
+}
+
+/*
+ * Same as keccak256Final() but only returns the leading 64 bits of each
+ * hash, as a big-endian number: enough to reject all but a few nonces.
+ */
+void keccak256FinalUpper(
+    const ethash::hash512* _seeds, const ethash::hash256* _mixes, uint64_t* _out)
+{
+    alignas(64) uint64_t state[25 * c_lanes];
+    keccak256FinalState(_seeds, _mixes, state);
+
+    for (size_t l = 0; l < c_lanes; l++)
+        _out[l] = bswap64(state[l]);
+}
+
+/*
+ * Big-endian comparison of 256-bit values
+ */
+inline bool isLessOrEqual(const ethash::hash256& _a, const ethash::hash256& _b) noexcept
+{
+    for (unsigned i = 0; i < 4; i++)
+    {
+        const uint64_t a = bswap64(_a.word64s[i]);
+        const uint64_t b = bswap64(_b.word64s[i]);
+        if (a != b)
+            return a < b;
+    }
+    return true;
+}
+
+inline const ethash::hash1024& item(const KernelDataset& _dataset, uint32_t _index) noexcept
+{
+    ethash::hash1024& item = _dataset.items[_index];
+    if (_dataset.lazy && item.word64s[0] == 0)
+        item = calculateKernelItem(*_dataset.dataset, _index);
+    return item;
+}
+
+inline void prefetch(const KernelDataset& _dataset, uint32_t _index) noexcept
+{
+    const char* p = reinterpret_cast<const char*>(&_dataset.items[_index]);
+#if defined(_MSC_VER)
+    _mm_prefetch(p, _MM_HINT_T0);
+    _mm_prefetch(p + 64, _MM_HINT_T0);
+#else
+    __builtin_prefetch(p);
+    __builtin_prefetch(p + 64);
+#endif
+}
+
+/*
+ * The ethash mixing loop: 64 dependent reads of 1024-bit dataset items,
+ * then compression of the 1024-bit mix down to 256 bits
+ */
+ethash::hash256 mixKernel(const KernelDataset& _dataset, const ethash::hash512& _seed) noexcept
+{
+    const uint32_t seedInit = _seed.word32s[0];
+
+    uint32_t mix[32];
+    for (unsigned i = 0; i < 32; i++)
+        mix[i] = _seed.word32s[i % 16];
+
+    for (uint32_t i = 0; i < c_datasetAccesses; i++)
+    {
+        const uint32_t p = fnv1(i ^ seedInit, mix[i % 32]) % _dataset.numItems;
+        const ethash::hash1024& it = item(_dataset, p);
+        for (unsigned j = 0; j < 32; j++)
+            mix[j] = fnv1(mix[j], it.word32s[j]);
+    }
+
+    ethash::hash256 mixHash;
+    for (unsigned i = 0; i < 32; i += 4)
+        mixHash.word32s[i / 4] = fnv1(fnv1(fnv1(mix[i], mix[i + 1]), mix[i + 2]), mix[i + 3]);
+    return mixHash;
+}
+
+bool searchLanes(const KernelDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations,
+    KernelSolution& _solution)
+{
+    uint64_t nonces[c_lanes];
+    ethash::hash512 seeds[c_lanes];
+    ethash::hash256 mixes[c_lanes] = {};
+    uint64_t uppers[c_lanes];
+    ethash::hash256 finals[c_lanes];
+
+    // Only a final hash whose leading word is at most this can be a solution
+    const uint64_t target = bswap64(_boundary.word64s[0]);
+
+    for (size_t done = 0; done < _iterations; done += c_lanes)
+    {
+        // A trailing partial group is hashed in full, extra lanes are ignored
+        const size_t lanes = minSize(c_lanes, _iterations - done);
+
+        for (size_t l = 0; l < c_lanes; l++)
+            nonces[l] = _startNonce + done + l;
+
+        keccak512HeaderNonce(_header, nonces, seeds);
+        for (size_t l = 0; l < lanes; l++)
+            mixes[l] = mixKernel(_dataset, seeds[l]);
+        keccak256FinalUpper(seeds, mixes, uppers);
+
+        // Lanes are checked in nonce order to return the lowest solution
+        for (size_t l = 0; l < lanes; l++)
+        {
+            if (uppers[l] > target)
+                continue;
+
+            // A candidate: hash it again in full
+            keccak256Final(seeds, mixes, finals);
+            if (isLessOrEqual(finals[l], _boundary))
+            {
+                _solution.nonce = nonces[l];
+                _solution.finalHash = finals[l];
+                _solution.mixHash = mixes[l];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool searchInterleaved(const KernelDataset& _dataset, const ethash::hash256& _header,
+    const ethash::hash256& _boundary, uint64_t _startNonce, size_t _iterations, unsigned _lanes,
+    KernelSolution& _solution)
+{
+    const uint32_t numItems = _dataset.numItems;
+    const size_t lanes = _lanes;
+    // Keccak runs on whole groups of c_lanes
+    const size_t keccakLanes = (lanes + c_lanes - 1) / c_lanes * c_lanes;
+
+    uint64_t nonces[c_maxInterleave];
+    ethash::hash512 seeds[c_maxInterleave];
+    ethash::hash256 mixes[c_maxInterleave] = {};
+    uint64_t uppers[c_maxInterleave];
+    ethash::hash256 finals[c_lanes];
+    uint32_t mix[c_maxInterleave][32];
+    uint32_t index[c_maxInterleave];
+
+    // Only a final hash whose leading word is at most this can be a solution
+    const uint64_t target = bswap64(_boundary.word64s[0]);
+
+    for (size_t done = 0; done < _iterations; done += lanes)
+    {
+        const size_t active = minSize(lanes, _iterations - done);
+
+        for (size_t l = 0; l < keccakLanes; l++)
+            nonces[l] = _startNonce + done + l;
+        for (size_t k = 0; k < keccakLanes; k += c_lanes)
+            keccak512HeaderNonce(_header, &nonces[k], &seeds[k]);
+
+        for (size_t l = 0; l < active; l++)
+            for (unsigned i = 0; i < 32; i++)
+                mix[l][i] = seeds[l].word32s[i % 16];
+
+        for (uint32_t i = 0; i < c_datasetAccesses; i++)
+        {
+            // Issue all lanes' reads first ...
+            for (size_t l = 0; l < active; l++)
+            {
+                index[l] = fnv1(i ^ seeds[l].word32s[0], mix[l][i % 32]) % numItems;
+                prefetch(_dataset, index[l]);
+            }
+
+            // ... then consume them
+            for (size_t l = 0; l < active; l++)
+            {
+                const ethash::hash1024& it = item(_dataset, index[l]);
+                for (unsigned j = 0; j < 32; j++)
+                    mix[l][j] = fnv1(mix[l][j], it.word32s[j]);
+            }
+        }
+
+        for (size_t l = 0; l < active; l++)
+            for (unsigned i = 0; i < 32; i += 4)
+                mixes[l].word32s[i / 4] =
+                    fnv1(fnv1(fnv1(mix[l][i], mix[l][i + 1]), mix[l][i + 2]), mix[l][i + 3]);
+
+        for (size_t k = 0; k < keccakLanes; k += c_lanes)
+            keccak256FinalUpper(&seeds[k], &mixes[k], &uppers[k]);
+
+        for (size_t l = 0; l < active; l++)
+        {
+            if (uppers[l] > target)
+                continue;
+
+            // A candidate: hash its Keccak group again in full
+            const size_t k = l / c_lanes * c_lanes;
+            keccak256Final(&seeds[k], &mixes[k], finals);
+            if (isLessOrEqual(finals[l - k], _boundary))
+            {
+                _solution.nonce = nonces[l];
+                _solution.finalHash = finals[l - k];
+                _solution.mixHash = mixes[l];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}  // namespace
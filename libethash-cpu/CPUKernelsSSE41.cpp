@@ -0,0 +1,30 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Hashing kernels built with -msse4.1 (see CMakeLists.txt). The lanes are
+// portable ones; SSE4.1 mostly pays off in the mixing loop (pmulld).
+
+#include "CPUKernelsImpl.h"
+
+#if defined(__SSE4_1__)
+constexpr bool c_compiled = true;
+#else
+constexpr bool c_compiled = false;
+#endif
+
+const dev::eth::CPUKernel dev::eth::c_kernelSSE41 = {"SSE4.1 x4", c_lanes, c_compiled,
+    &keccak512HeaderNonce, &keccak256Final, &searchLanes, &searchInterleaved};
@@ -32,14 +32,15 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <libethcore/Farm.h>
 #include <ethash/ethash.hpp>
 
-#include <boost/version.hpp>
-
 #if 0
 #include <boost/fiber/numa/pin_thread.hpp>
 #include <boost/fiber/numa/topology.hpp>
 #endif
 
+#include "CPUHashimoto.h"
 #include "CPUMiner.h"
+#include "CPUTopology.h"
+#include "KeccakLanes.h"
 
 
 /* Sanity check for defined OS */
@@ -59,6 +60,16 @@ using namespace dev;
 using namespace eth;
 
 
+constexpr size_t c_maxBatchSize = 65536;  // Nonces hashed between two checks for new work
+
+static inline int64_t steadyNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+
 /* ################## OS-specific functions ################## */
 
 /*
@@ -99,37 +110,27 @@ static size_t getTotalPhysAvailableMemory()
 }
 
 /*
- * return numbers of available CPUs
+ * binds the calling thread to a specific CPU
  */
-unsigned CPUMiner::getNumDevices()
+static bool bindThreadToCpu(unsigned _cpu)
 {
-#if 0
-    static unsigned cpus = 0;
-
-    if (cpus == 0)
-    {
-        std::vector< boost::fibers::numa::node > topo = boost::fibers::numa::topology();
-        for (auto n : topo) {
-            cpus += n.logical_cpus.size();
-        }
-    }
-    return cpus;
-#elif defined(__APPLE__) || defined(__MACOSX)
-#error "TODO: Function CPUMiner::getNumDevices() on MAXOSX not implemented"
+#if defined(__APPLE__) || defined(__MACOSX)
+#error "TODO: Function CPUMiner bindThreadToCpu() on MAXOSX not implemented"
 #elif defined(__linux__)
-    long cpus_available;
-    cpus_available = sysconf(_SC_NPROCESSORS_ONLN);
-    if (cpus_available == -1L)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(_cpu, &cpuset);
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0)
     {
-        cwarn << "Error in func " << __FUNCTION__ << " at sysconf(_SC_NPROCESSORS_ONLN) \""
-              << strerror(errno) << "\"\n";
-        return 0;
+        cwarn << "Error in func " << __FUNCTION__ << " at sched_setaffinity() \"" << strerror(errno)
+              << "\"\n";
+        return false;
     }
-    return cpus_available;
+    return true;
 #else
-    SYSTEM_INFO sysinfo;
-    GetSystemInfo(&sysinfo);
-    return sysinfo.dwNumberOfProcessors;
+    DWORD_PTR dwThreadAffinityMask = 1i64 << _cpu;
+    // Handle Errorcode (GetLastError) ??
+    return SetThreadAffinityMask(GetCurrentThread(), dwThreadAffinityMask) != NULL;
 #endif
 }
 
@@ -144,18 +145,29 @@ struct CPUChannel : public LogChannel
 #define cpulog clog(CPUChannel)
 
 
+vector<unsigned> CPUMiner::s_allowedCpus;
+map<int, vector<unsigned>> CPUMiner::s_nodeCpus;
+
+
 CPUMiner::CPUMiner(unsigned _index, CPSettings _settings, DeviceDescriptor& _device)
   : Miner("cpu-", _index), m_settings(_settings)
 {
     m_deviceDescriptor = _device;
+
+    // Made here once and for all, as getDetails() reads them
+    if (m_settings.light)
+        for (size_t i = 0; i < std::max<size_t>(m_deviceDescriptor.cpCpus.size(), 1); i++)
+            m_itemCaches.emplace_back(new CPUItemCache(size_t(m_settings.lightCache) << 20));
 }
 
 
 CPUMiner::~CPUMiner()
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::~CPUMiner() begin");
-    stopWorking();
+    triggerStopWorking();
     kick_miner();
+    stopWorking();
+    stopPool();
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::~CPUMiner() end");
 }
 
@@ -167,37 +179,27 @@ bool CPUMiner::initDevice()
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::initDevice begin");
 
+    if (m_deviceDescriptor.cpCpus.size())
+    {
+        ostringstream cpus;
+        for (unsigned cpu : m_deviceDescriptor.cpCpus)
+            cpus << (cpus.tellp() ? "," : "") << cpu;
+        cpulog << "Using " << m_deviceDescriptor.cpCpus.size() << " CPUs: " << cpus.str()
+               << " Memory : " << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory);
+
+        // This thread only hands out jobs, hashing is done by the pool
+        startPool();
+        DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::initDevice end");
+        return true;
+    }
+
     cpulog << "Using CPU: " << m_deviceDescriptor.cpCpuNumer << " " << m_deviceDescriptor.cuName
            << " Memory : " << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory);
 
-#if defined(__APPLE__) || defined(__MACOSX)
-#error "TODO: Function CPUMiner::initDevice() on MAXOSX not implemented"
-#elif defined(__linux__)
-    cpu_set_t cpuset;
-    int err;
-
-    CPU_ZERO(&cpuset);
-    CPU_SET(m_deviceDescriptor.cpCpuNumer, &cpuset);
-
-    err = sched_setaffinity(0, sizeof(cpuset), &cpuset);
-    if (err != 0)
-    {
-        cwarn << "Error in func " << __FUNCTION__ << " at sched_setaffinity() \"" << strerror(errno)
-              << "\"\n";
-        cwarn << "cp-" << m_index << "could not bind thread to cpu" << m_deviceDescriptor.cpCpuNumer
-              << "\n";
-    }
-#else
-    DWORD_PTR dwThreadAffinityMask = 1i64 << m_deviceDescriptor.cpCpuNumer;
-    DWORD_PTR previous_mask;
-    previous_mask = SetThreadAffinityMask(GetCurrentThread(), dwThreadAffinityMask);
-    if (previous_mask == NULL)
-    {
+    if (!bindThreadToCpu(m_deviceDescriptor.cpCpuNumer))
         cwarn << "cp-" << m_index << "could not bind thread to cpu" << m_deviceDescriptor.cpCpuNumer
               << "\n";
-        // Handle Errorcode (GetLastError) ??
-    }
-#endif
+
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::initDevice end");
     return true;
 }
@@ -212,10 +214,165 @@ bool CPUMiner::initDevice()
  */
 bool CPUMiner::initEpoch_internal()
 {
+    // Drop our references to the previous epoch before allocating the new one
+    m_dataset.reset();
+    atomic_store(&m_poolJob, std::shared_ptr<const PoolJob>());
+
+    if (m_settings.light)
+    {
+        try
+        {
+            m_dataset = CPUDataset::light(m_epochContext, m_settings.pages,
+                m_settings.numa ? m_deviceDescriptor.cpNumaNode : -1);
+        }
+        catch (const std::bad_alloc&)
+        {
+            cpulog << "Unable to allocate "
+                   << dev::getFormattedMemory((double)m_epochContext.lightSize)
+                   << " of light cache";
+            pause(MinerPauseEnum::PauseDueToInitEpochError);
+            return false;
+        }
+        atomic_store(&m_publishedDataset, m_dataset);
+
+        cpulog << "Light mode: light cache "
+               << dev::getFormattedMemory((double)m_dataset->memory()) << " on "
+               << pageBackingName(m_dataset->lightBacking()) << ", item cache "
+               << dev::getFormattedMemory((double)m_itemCaches[0]->memory()) << " x "
+               << m_itemCaches.size() << " threads instead of "
+               << dev::getFormattedMemory((double)m_dataset->size()) << " of DAG";
+        return true;
+    }
+
+    try
+    {
+        m_dataset = CPUDataset::get(m_epochContext, m_settings.pages,
+            m_settings.numa ? m_deviceDescriptor.cpNumaNode : -1, Farm::f().dagStore());
+    }
+    catch (const std::bad_alloc&)
+    {
+        cpulog << "Unable to allocate " << dev::getFormattedMemory((double)m_epochContext.dagSize)
+               << " of DAG data";
+        pause(MinerPauseEnum::PauseDueToInitEpochError);
+        return false;
+    }
+
+    // Publish for getDetails()
+    atomic_store(&m_publishedDataset, m_dataset);
+
+    cpulog << "DAG " << dev::getFormattedMemory((double)m_dataset->size()) << " on "
+           << pageBackingName(m_dataset->backing()) << ", light cache on "
+           << pageBackingName(m_dataset->lightBacking())
+           << (m_settings.numa ? ", replica of node " + to_string(m_dataset->numaNode()) : "");
+
+    // All allowed CPUs generate the DAG, those of its node only for a replica: replicas
+    // are generated at the same time. Miners sharing it wait here so that hashing starts
+    // only once it is complete.
+    auto node = m_settings.numa ? s_nodeCpus.find(m_dataset->numaNode()) : s_nodeCpus.end();
+    const vector<unsigned>& cpus = node != s_nodeCpus.end() ? node->second : s_allowedCpus;
+    const unsigned threads = m_settings.dagThreads ? m_settings.dagThreads : unsigned(cpus.size());
+    auto startInit = std::chrono::steady_clock::now();
+    m_dataset->generate(
+        threads,
+        [&cpus](unsigned _ordinal) {
+            if (cpus.size())
+                bindThreadToCpu(cpus[_ordinal % cpus.size()]);
+        },
+        [this](const DagProgress& _p) {
+            if (_p.finished)
+                return;
+            cpulog << "DAG generation " << std::fixed << std::setprecision(2)
+                   << (100.0 * _p.done / _p.total) << "% " << uint64_t(_p.itemsPerSecond)
+                   << " items/s ETA " << uint64_t(_p.etaSeconds) << " s";
+        },
+        [this]() { return shouldStop(); });
+
+    if (shouldStop())
+        return false;
+
+    auto dagTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startInit);
+    cpulog << dev::getFormattedMemory((double)m_dataset->size()) << " of DAG data "
+           << (m_dataset->fromStore() ? "loaded" : "ready") << " in " << dagTime.count() << " ms.";
+
+    // Save for the next run without delaying hashing. NUMA replicas are identical.
+    DagStore* store = Farm::f().dagStore();
+    if (store && !m_dataset->fromStore() &&
+        !store->contains(DagStoreKind::Full, m_dataset->epoch()))
+        m_dataset->saveAsync(*store);
+
+    // Lane kernels must give the very same results as ethash.
+    // If they don't, mine with ethash's scalar search.
+    m_lanesVerified =
+        verifyLanes(*m_dataset, ethash::get_global_epoch_context(m_epochContext.epochNumber));
+    if (m_lanesVerified)
+        cpulog << "Using " << keccakLanesKernelName() << " Keccak kernels, "
+               << (m_settings.interleave ? m_settings.interleave : 1) << " nonces interleaved";
+    else
+        cwarn << "cp-" << m_index << " " << keccakLanesKernelName()
+              << " Keccak kernels failed verification. Falling back to scalar Keccak";
+
     return true;
 }
 
 
+Json::Value CPUMiner::getDetails()
+{
+    Json::Value jRes;
+    auto dataset = atomic_load(&m_publishedDataset);
+    if (dataset)
+    {
+        DagProgress progress = dataset->progress();
+        Json::Value jGen;
+        jGen["done"] = progress.done;
+        jGen["total"] = progress.total;
+        jGen["items_per_second"] = uint64_t(progress.itemsPerSecond);
+        jGen["eta"] = uint64_t(progress.etaSeconds);
+        jGen["finished"] = progress.finished;
+        jRes["dag_generation"] = jGen;
+        if (!dataset->isLight())
+            jRes["dag_pages"] = pageBackingName(dataset->backing());
+        jRes["light_pages"] = pageBackingName(dataset->lightBacking());
+    }
+    if (m_settings.light)
+    {
+        Json::Value jLight;
+        jLight["light_cache"] = uint64_t(dataset ? dataset->memory() : 0);
+        Json::Value jThreads(Json::arrayValue);
+        for (const auto& cache : m_itemCaches)
+        {
+            const uint64_t hits = cache->hits();
+            const uint64_t lookups = hits + cache->misses();
+            Json::Value jThread;
+            jThread["item_cache"] = uint64_t(cache->memory());
+            jThread["hit_rate"] = lookups ? double(hits) / lookups : 0.0;
+            jThreads.append(jThread);
+        }
+        jLight["threads"] = jThreads;
+        jRes["light"] = jLight;
+    }
+    jRes["numa_node"] = m_deviceDescriptor.cpNumaNode;
+    jRes["interleave"] = m_settings.interleave;
+    jRes["kernel"] = keccakLanesKernelName();
+    jRes["batch_size"] = m_batchSize.load(std::memory_order_relaxed);
+    Json::Value jSwitch;
+    jSwitch["bound"] = m_settings.switchLatency;
+    jSwitch["count"] = m_switchCount.load();
+    jSwitch["last"] = m_switchLastUs.load();
+    jSwitch["avg"] = m_switchAvgUs.load();
+    jSwitch["max"] = m_switchMaxUs.load();
+    jRes["switch_latency_us"] = jSwitch;
+    if (m_deviceDescriptor.cpCpus.size())
+    {
+        Json::Value jPool;
+        jPool["threads"] = unsigned(m_deviceDescriptor.cpCpus.size());
+        jPool["steals"] = m_steals.load(std::memory_order_relaxed);
+        jRes["pool"] = jPool;
+    }
+    return jRes;
+}
+
+
 /*
    Miner should stop working on the current block
    This happens if a
@@ -225,46 +382,383 @@ bool CPUMiner::initEpoch_internal()
 */
 void CPUMiner::kick_miner()
 {
+    m_kickTime.store(steadyNs(), std::memory_order_relaxed);
     m_new_work.store(true, std::memory_order_relaxed);
-    m_new_work_signal.notify_one();
+
+    // Pool threads drop the current job at their next batch
+    m_poolGeneration.fetch_add(1);
+
+    wakeWork();
+}
+
+
+/*
+ * Sizes the next batch from the time taken by the last one.
+ * Hashes per second only grow with the batch size (the loop overhead is
+ * spread on more nonces), so batches are made as large as the job switch
+ * latency bound allows: a kick waits at most one batch. A quarter of the
+ * bound is left for waking up and switching.
+ */
+size_t CPUMiner::tuneBatchSize(
+    size_t _batch, int64_t _elapsedNs, size_t _lanes, double& _hashTimeNs)
+{
+    const double perHash = double(_elapsedNs) / _batch;
+    _hashTimeNs = _hashTimeNs > 0.0 ? 0.9 * _hashTimeNs + 0.1 * perHash : perHash;
+
+    const double target = 0.75 * m_settings.switchLatency * 1000.0 / _hashTimeNs;
+    size_t batch = size_t(target) / _lanes * _lanes;
+    batch = std::min(std::max(batch, _lanes), c_maxBatchSize / _lanes * _lanes);
+    m_batchSize.store(unsigned(batch), std::memory_order_relaxed);
+    return batch;
+}
+
+
+void CPUMiner::recordSwitch(int64_t _latencyNs)
+{
+    const double us = _latencyNs / 1000.0;
+    const unsigned n = m_switchCount.load(std::memory_order_relaxed) + 1;
+    const double avg = m_switchAvgUs.load(std::memory_order_relaxed);
+    m_switchAvgUs.store(n == 1 ? us : avg + (us - avg) / std::min(n, 100u));
+    m_switchLastUs.store(us);
+    m_switchMaxUs.store(std::max(m_switchMaxUs.load(), us));
+    m_switchCount.store(n);
+}
+
+
+ethash::search_result CPUMiner::searchBatch(CPUDataset& _dataset, CPUItemCache* _cache,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _nonce,
+    size_t _count)
+{
+    if (_dataset.isLight())
+        return searchLight(_dataset, *_cache, _header, _boundary, _nonce, _count);
+    if (!m_lanesVerified)
+        return searchScalar(_dataset, _header, _boundary, _nonce, _count);
+    if (m_settings.interleave)
+        return searchInterleaved(
+            _dataset, _header, _boundary, _nonce, _count, m_settings.interleave);
+    return searchLanes(_dataset, _header, _boundary, _nonce, _count);
+}
+
+
+void CPUMiner::searchAndSubmit(CPUDataset& _dataset, CPUItemCache* _cache,
+    const ethash::hash256& _header, const ethash::hash256& _boundary, const WorkPackage& _w,
+    uint64_t _nonce, size_t _count)
+{
+    // Searches stop at their first solution: go on past it to the end of the batch
+    while (_count)
+    {
+        auto r = searchBatch(_dataset, _cache, _header, _boundary, _nonce, _count);
+        if (!r.solution_found)
+            return;
+        submitSolution(r, _w);
+        const uint64_t searched = r.nonce + 1 - _nonce;
+        if (searched >= _count)
+            return;
+        _nonce = r.nonce + 1;
+        _count -= size_t(searched);
+    }
+}
+
+
+void CPUMiner::submitSolution(const ethash::search_result& _r, const WorkPackage& _w)
+{
+    h256 mix{reinterpret_cast<const byte*>(_r.mix_hash.bytes), h256::ConstructFromPointer};
+    auto sol = Solution{_r.nonce, mix, _w, std::chrono::steady_clock::now(), m_index};
+
+    cpulog << EthWhite << "Job: " << _w.header.abridged()
+           << " Sol: " << toHex(sol.nonce, HexPrefix::Add) << EthReset;
+    Farm::f().submitProof(sol);
 }
 
 
 void CPUMiner::search(const dev::eth::WorkPackage& w)
 {
-    constexpr size_t blocksize = 30;
+    if (m_switchStart)
+    {
+        recordSwitch(steadyNs() - m_switchStart);
+        m_switchStart = 0;
+    }
+
+    // Keep a multiple of the nonces hashed together so no lane is wasted
+    const size_t lanes = m_settings.interleave ? m_settings.interleave : keccakLanes();
+    size_t blocksize = m_batchSize.load(std::memory_order_relaxed);
+    if (!blocksize)
+        blocksize = (32 + lanes - 1) / lanes * lanes;
 
-    const auto& context = ethash::get_global_epoch_context_full(w.epoch);
+    CPUDataset& dataset = *m_dataset;
+    CPUItemCache* cache = m_settings.light ? m_itemCaches[0].get() : nullptr;
     const auto header = ethash::hash256_from_bytes(w.header.data());
     const auto boundary = ethash::hash256_from_bytes(w.boundary.data());
     auto nonce = w.startNonce;
+    uint64_t count = restartNonces(w, blocksize);
+
+    while (true)
+    {
+        if (m_new_work.load(std::memory_order_relaxed))  // new work arrived ?
+        {
+            m_switchStart = m_kickTime.load(std::memory_order_relaxed);
+            m_new_work.store(false, std::memory_order_relaxed);
+            break;
+        }
+
+        if (shouldStop())
+            break;
+
+        if (!count)
+        {
+            // Every nonce of the job is taken: wait for the next one
+            boost::mutex::scoped_lock l(x_work);
+            while (!m_new_work.load(std::memory_order_relaxed) && !shouldStop())
+                m_new_work_signal.wait(l);
+            continue;
+        }
+
+        const int64_t batchStart = steadyNs();
+        searchAndSubmit(dataset, cache, header, boundary, w, nonce, size_t(count));
+
+        // Update the hash rate. Batch sizes vary: count nonces, not batches.
+        updateHashRate(1, uint32_t(count));
+
+        blocksize = tuneBatchSize(size_t(count), steadyNs() - batchStart, lanes, m_hashTimeNs);
+        count = nextNonces(w, nonce, blocksize);
+    }
+}
+
+
+void CPUMiner::startPool()
+{
+    stopPool();
+    m_pool.clear();
+    m_poolStop = false;
+    for (unsigned cpu : m_deviceDescriptor.cpCpus)
+    {
+        m_pool.emplace_back(new PoolThread);
+        m_pool.back()->cpu = cpu;
+    }
+    // Threads steal from each other: all must exist before any runs
+    for (unsigned i = 0; i < m_pool.size(); i++)
+        m_pool[i]->thread = std::thread(&CPUMiner::poolLoop, this, i);
+}
+
+
+void CPUMiner::stopPool()
+{
+    {
+        lock_guard<mutex> l(x_pool);
+        m_poolStop = true;
+    }
+    m_poolSignal.notify_all();
+    for (auto& t : m_pool)
+        if (t->thread.joinable())
+            t->thread.join();
+}
+
+
+/*
+ * Publishes a job to the pool threads then waits for the next one.
+ * The nonce range of the miner is split evenly between the threads.
+ * A thread running out of nonces steals half of what another has left,
+ * then takes chunks from the farm's shared pool.
+ */
+void CPUMiner::searchPool(const WorkPackage& w)
+{
+    if (m_switchStart)
+    {
+        recordSwitch(steadyNs() - m_switchStart);
+        m_switchStart = 0;
+    }
+
+    auto job = std::make_shared<PoolJob>();
+    job->work = w;
+    job->header = ethash::hash256_from_bytes(w.header.data());
+    job->boundary = ethash::hash256_from_bytes(w.boundary.data());
+    job->dataset = m_dataset;
+
+    uint64_t total = w.nonceCount;
+    if (!total)
+    {
+        const unsigned width = Farm::f().get_segment_width();
+        total = width >= 64 ? ~uint64_t(0) : uint64_t(1) << width;
+    }
+    // First, so that threads still claiming for the last job leave the new ranges alone.
+    // A kick from here on makes the threads skip this job.
+    job->generation = m_poolGeneration.fetch_add(1) + 1;
+
+    const uint64_t span = total / m_pool.size();
+    for (unsigned i = 0; i < m_pool.size(); i++)
+    {
+        lock_guard<mutex> l(m_pool[i]->x_range);
+        m_pool[i]->begin = i * span;
+        m_pool[i]->end = (i + 1) * span;
+        m_pool[i]->generation = job->generation;
+    }
+
+    {
+        lock_guard<mutex> l(x_pool);
+        atomic_store(&m_poolJob, std::shared_ptr<const PoolJob>(job));
+    }
+    m_poolSignal.notify_all();
+
+    // Fold the hashes of all threads into the miner's hash rate
+    auto poolHashes = [this]() {
+        uint64_t hashes = 0;
+        for (auto& t : m_pool)
+            hashes += t->hashes.load(std::memory_order_relaxed);
+        return hashes;
+    };
+    uint64_t folded = poolHashes();
 
     while (true)
     {
+        {
+            boost::mutex::scoped_lock l(x_work);
+            if (!m_new_work.load(std::memory_order_relaxed) && !shouldStop())
+                m_new_work_signal.timed_wait(l, boost::posix_time::milliseconds(100));
+        }
+
+        const uint64_t hashes = poolHashes();
+        if (hashes != folded)
+            updateHashRate(1, uint32_t(hashes - folded));
+        folded = hashes;
+
         if (m_new_work.load(std::memory_order_relaxed))  // new work arrived ?
         {
+            m_switchStart = m_kickTime.load(std::memory_order_relaxed);
             m_new_work.store(false, std::memory_order_relaxed);
             break;
         }
 
         if (shouldStop())
             break;
+    }
+}
 
 
-        auto r = ethash::search(context, header, boundary, nonce, blocksize);
-        if (r.solution_found)
+/*
+ * Takes up to _count nonces from the thread's own range or, once it is
+ * drained, from the largest range left, then from the farm's shared pool.
+ * Returns false if all are drained. _nonce is an offset from the start
+ * nonce of the miner.
+ */
+bool CPUMiner::claimNonces(
+    unsigned _ordinal, const PoolJob& _job, uint64_t _count, uint64_t& _nonce, uint64_t& _claimed)
+{
+    PoolThread& self = *m_pool[_ordinal];
+    {
+        lock_guard<mutex> l(self.x_range);
+        if (self.generation != _job.generation)
+            return false;
+        if (self.begin < self.end)
         {
-            h256 mix{reinterpret_cast<byte*>(r.mix_hash.bytes), h256::ConstructFromPointer};
-            auto sol = Solution{r.nonce, mix, w, std::chrono::steady_clock::now(), m_index};
+            _nonce = self.begin;
+            _claimed = std::min(_count, self.end - self.begin);
+            self.begin += _claimed;
+            return true;
+        }
+    }
 
-            cpulog << EthWhite << "Job: " << w.header.abridged()
-                   << " Sol: " << toHex(sol.nonce, HexPrefix::Add) << EthReset;
-            Farm::f().submitProof(sol);
+    while (true)
+    {
+        PoolThread* victim = nullptr;
+        uint64_t most = 0;
+        for (unsigned i = 0; i < m_pool.size(); i++)
+        {
+            if (i == _ordinal)
+                continue;
+            lock_guard<mutex> l(m_pool[i]->x_range);
+            if (m_pool[i]->generation == _job.generation &&
+                m_pool[i]->end - m_pool[i]->begin > most)
+            {
+                most = m_pool[i]->end - m_pool[i]->begin;
+                victim = m_pool[i].get();
+            }
+        }
+        if (!victim)
+        {
+            uint64_t start, count;
+            if (!_job.work.nonceCount ||
+                !Farm::f().claimNonces(m_index, _job.work.header, _count, start, count))
+                return false;
+
+            // The pool lies after the ranges of all miners: offsets don't wrap
+            lock_guard<mutex> l(self.x_range);
+            if (self.generation != _job.generation)
+                return false;
+            _nonce = start - _job.work.startNonce;
+            _claimed = std::min(_count, count);
+            self.begin = _nonce + _claimed;
+            self.end = _nonce + count;
+            return true;
         }
-        nonce += blocksize;
 
-        // Update the hash rate
-        updateHashRate(blocksize, 1);
+        uint64_t begin, end;
+        {
+            lock_guard<mutex> l(victim->x_range);
+            if (victim->generation != _job.generation)
+                return false;  // Switched to another job meanwhile
+            if (victim->begin >= victim->end)
+                continue;  // Drained meanwhile, look again
+            // Leave small ranges whole to the thief
+            const uint64_t left = victim->end - victim->begin;
+            end = victim->end;
+            begin = left > 2 * _count ? victim->begin + left / 2 : victim->begin;
+            victim->end = begin;
+        }
+        m_steals.fetch_add(1, std::memory_order_relaxed);
+
+        lock_guard<mutex> l(self.x_range);
+        if (self.generation != _job.generation)
+            return false;
+        _nonce = begin;
+        _claimed = std::min(_count, end - begin);
+        self.begin = begin + _claimed;
+        self.end = end;
+        return true;
+    }
+}
+
+
+void CPUMiner::poolLoop(unsigned _ordinal)
+{
+    PoolThread& self = *m_pool[_ordinal];
+    setThreadName(("cp" + to_string(m_index) + "." + to_string(_ordinal)).c_str());
+    if (!bindThreadToCpu(self.cpu))
+        cwarn << "cp-" << m_index << " could not bind pool thread to cpu " << self.cpu;
+
+    const size_t lanes = m_settings.interleave ? m_settings.interleave : keccakLanes();
+    size_t batch = (32 + lanes - 1) / lanes * lanes;
+    CPUItemCache* cache = m_settings.light ? m_itemCaches[_ordinal].get() : nullptr;
+
+    while (!m_poolStop.load(std::memory_order_relaxed))
+    {
+        auto job = atomic_load(&m_poolJob);
+        uint64_t offset, count;
+        if (!job || job->generation != m_poolGeneration.load(std::memory_order_relaxed) ||
+            !claimNonces(_ordinal, *job, batch, offset, count))
+        {
+            // Wait for the next job
+            const uint64_t generation = job ? job->generation : 0;
+            job.reset();
+            unique_lock<mutex> l(x_pool);
+            m_poolSignal.wait(l, [this, generation]() {
+                auto next = atomic_load(&m_poolJob);
+                return m_poolStop.load() ||
+                       (next && next->generation != generation &&
+                           next->generation == m_poolGeneration.load());
+            });
+            continue;
+        }
+
+        // A switch may have reset the ranges while claiming
+        if (job->generation != m_poolGeneration.load(std::memory_order_relaxed))
+            continue;
+
+        const int64_t batchStart = steadyNs();
+        searchAndSubmit(*job->dataset, cache, job->header, job->boundary, job->work,
+            job->work.startNonce + offset, count);
+        self.hashes.fetch_add(count, std::memory_order_relaxed);
+
+        batch = tuneBatchSize(count, steadyNs() - batchStart, lanes, self.hashTimeNs);
     }
 }
 
@@ -279,27 +773,32 @@ void CPUMiner::workLoop()
     WorkPackage current;
     current.header = h256();
 
+    // The newest work package, copied only when it changes
+    WorkPackage w;
+    uint64_t generation = c_noWorkGeneration;
+
     if (!initDevice())
         return;
 
     while (!shouldStop())
     {
-        // Wait for work or 3 seconds (whichever the first)
-        const WorkPackage w = work();
+        // Wait for work
+        if (workGeneration() != generation)
+            w = work(&generation);
         if (!w)
         {
-            boost::system_time const timeout =
-                boost::get_system_time() + boost::posix_time::seconds(3);
-            boost::mutex::scoped_lock l(x_work);
-            m_new_work_signal.timed_wait(l, timeout);
+            // Pauses are not job switches
+            m_switchStart = 0;
+            waitForWork(generation);
             continue;
         }
 
-        if (w.algo == "ethash")
+        if (w.algo == AlgoEnum::Ethash)
         {
             // Epoch change ?
             if (current.epoch != w.epoch)
             {
+                m_switchStart = 0;
                 if (!initEpoch())
                     break;  // This will simply exit the thread
 
@@ -315,24 +814,124 @@ void CPUMiner::workLoop()
             current = w;
 
             // Start searching
-            search(w);
+            workStarted(generation);
+            if (m_pool.size())
+                searchPool(w);
+            else
+                search(w);
         }
         else
         {
-            throw std::runtime_error("Algo : " + w.algo + " not yet implemented");
+            throw std::runtime_error(
+                std::string("Algo : ") + algoName(w.algo) + " not yet implemented");
         }
     }
 
+    stopPool();
+
     DEV_BUILD_LOG_PROGRAMFLOW(cpulog, "cp-" << m_index << " CPUMiner::workLoop() end");
 }
 
 
-void CPUMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection)
+vector<CPUMiner::LightBenchPoint> CPUMiner::benchLight(
+    int _epoch, const vector<unsigned>& _cacheMiB, unsigned _seconds)
+{
+    std::shared_ptr<ethash::epoch_context> context = ethash::create_epoch_context(_epoch);
+    if (!context)
+        throw std::bad_alloc();
+    EpochContext ec = {};
+    ec.epochNumber = _epoch;
+    ec.lightNumItems = context->light_cache_num_items;
+    ec.lightSize = ethash::get_light_cache_size(ec.lightNumItems);
+    ec.lightCache = context->light_cache;
+    ec.dagNumItems = context->full_dataset_num_items;
+    ec.dagSize = ethash::get_full_dataset_size(ec.dagNumItems);
+    std::shared_ptr<CPUDataset> dataset = CPUDataset::light(ec, PageBackingEnum::Normal);
+    context.reset();
+
+    // Never solves: every nonce is hashed in full
+    const auto header = ethash::calculate_epoch_seed(_epoch + 1);
+    ethash::hash256 boundary = {};
+    const size_t batch = 64;
+
+    vector<LightBenchPoint> points;
+    uint64_t nonce = 0;
+    for (unsigned mib : _cacheMiB)
+    {
+        CPUItemCache cache(size_t(mib) << 20);
+
+        // Fill the cache first, within the time of a measure
+        const int64_t warmEnd = steadyNs() + int64_t(_seconds) * 1000000000;
+        while (cache.misses() < cache.capacity() && steadyNs() < warmEnd)
+        {
+            searchLight(*dataset, cache, header, boundary, nonce, batch);
+            nonce += batch;
+        }
+
+        const uint64_t hits = cache.hits();
+        const uint64_t misses = cache.misses();
+        const int64_t start = steadyNs();
+        uint64_t hashes = 0;
+        while (steadyNs() - start < int64_t(_seconds) * 1000000000)
+        {
+            searchLight(*dataset, cache, header, boundary, nonce, batch);
+            nonce += batch;
+            hashes += batch;
+        }
+        const double seconds = (steadyNs() - start) / 1e9;
+        const uint64_t lookups = cache.hits() - hits + cache.misses() - misses;
+
+        LightBenchPoint p;
+        p.itemCache = cache.memory();
+        p.memory = size_t(dataset->memory()) + cache.memory();
+        p.hitRate = lookups ? double(cache.hits() - hits) / lookups : 0.0;
+        p.hashesPerSecond = hashes / seconds;
+        points.push_back(p);
+    }
+    return points;
+}
+
+
+void CPUMiner::enumDevices(
+    std::map<string, DeviceDescriptor>& _DevicesCollection, const CPSettings& _settings)
 {
-    unsigned numDevices = getNumDevices();
+    // Enumeration runs on the main thread, before any miner pins itself
+    const CPUTopology topology = readCPUTopology();
+    if (topology.maxThreads() < topology.cpus.size())
+        cnote << "CPU quota of " << topology.quota << " CPUs, using at most "
+              << topology.maxThreads() << " threads";
+    s_allowedCpus.clear();
+    s_nodeCpus.clear();
+    for (const auto& c : selectCpus(topology, CPUSelectEnum::Logical))
+    {
+        s_allowedCpus.push_back(c.id);
+        s_nodeCpus[c.numaNode].push_back(c.id);
+    }
+
+    const vector<LogicalCpu> cpus = selectCpus(topology, _settings.cpuSelect, _settings.cpuList);
+
+    // One device per CPU, or one per socket / host driving a pool of threads
+    vector<vector<LogicalCpu>> groups;
+    for (const auto& c : cpus)
+    {
+        if (_settings.group == CPUGroupEnum::Cpu || groups.empty())
+            groups.push_back({c});
+        else if (_settings.group == CPUGroupEnum::Host)
+            groups.back().push_back(c);
+        else
+        {
+            auto g = find_if(groups.begin(), groups.end(),
+                [&c](const vector<LogicalCpu>& _g) { return _g[0].package == c.package; });
+            if (g == groups.end())
+                groups.push_back({c});
+            else
+                g->push_back(c);
+        }
+    }
 
-    for (unsigned i = 0; i < numDevices; i++)
+    for (unsigned i = 0; i < groups.size(); i++)
     {
+        const vector<LogicalCpu>& group = groups[i];
         string uniqueId;
         ostringstream s;
         DeviceDescriptor deviceDescriptor;
@@ -346,14 +945,22 @@ void CPUMiner::enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollectio
 
         s.str("");
         s.clear();
-        s << "ethash::eval()/boost " << (BOOST_VERSION / 100000) << "."
-          << (BOOST_VERSION / 100 % 1000) << "." << (BOOST_VERSION % 100);
+        if (_settings.group == CPUGroupEnum::Socket)
+            s << "socket " << group[0].package << ", " << group.size() << " CPUs, ";
+        else if (_settings.group == CPUGroupEnum::Host)
+            s << "host, " << group.size() << " CPUs, ";
+        s << "ethash " << activeCPUKernel().name << " kernels";
         deviceDescriptor.name = s.str();
         deviceDescriptor.uniqueId = uniqueId;
         deviceDescriptor.type = DeviceTypeEnum::Cpu;
         deviceDescriptor.totalMemory = getTotalPhysAvailableMemory();
 
-        deviceDescriptor.cpCpuNumer = i;
+        deviceDescriptor.cpCpuNumer = group[0].id;
+        deviceDescriptor.cpNumaNode = group[0].numaNode;
+        deviceDescriptor.cpCpus.clear();
+        if (_settings.group != CPUGroupEnum::Cpu)
+            for (const auto& c : group)
+                deviceDescriptor.cpCpus.push_back(c.id);
 
         _DevicesCollection[uniqueId] = deviceDescriptor;
     }
@@ -21,7 +21,15 @@ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <libethcore/EthashAux.h>
 #include <libethcore/Miner.h>
 
+#include <condition_variable>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "CPUDataset.h"
+#include "CPUItemCache.h"
 
 namespace dev
 {
@@ -33,22 +41,119 @@ public:
     CPUMiner(unsigned _index, CPSettings _settings, DeviceDescriptor& _device);
     ~CPUMiner() override;
 
-    static unsigned getNumDevices();
-    static void enumDevices(std::map<string, DeviceDescriptor>& _DevicesCollection);
+    /**
+     * @brief Adds a device per CPU selected by _settings among the allowed ones
+     * With a group other than Cpu a device holds the CPUs of a socket or host.
+     */
+    static void enumDevices(
+        std::map<string, DeviceDescriptor>& _DevicesCollection, const CPSettings& _settings);
+
+    /**
+     * @brief CPUs worth running on, within the cgroup quota, once enumDevices() ran
+     */
+    static const std::vector<unsigned>& allowedCpus() { return s_allowedCpus; }
+
+    struct LightBenchPoint
+    {
+        size_t itemCache;       // Bytes of the item cache
+        size_t memory;          // Bytes used by a thread: light cache and item cache
+        double hitRate;         // Of the item cache
+        double hashesPerSecond;
+    };
+
+    /**
+     * @brief Measures light mode hashing on the calling thread
+     * One point per item cache size in _cacheMiB, each hashing _seconds
+     * once its cache is warm. Throws std::bad_alloc if the light cache of
+     * _epoch can not be allocated.
+     */
+    static std::vector<LightBenchPoint> benchLight(
+        int _epoch, const std::vector<unsigned>& _cacheMiB, unsigned _seconds);
 
     void search(const dev::eth::WorkPackage& w);
 
     void clearDAG() override{};
 
+    Json::Value getDetails() override;
+
 protected:
     bool initDevice() override;
     bool initEpoch_internal() override;
+    bool dagLoadScheduled() const override { return false; }  // Host CPUs, not GPU power
     void kick_miner() override;
 
 private:
+    // What the threads of a grouped device hash
+    struct PoolJob
+    {
+        WorkPackage work;
+        ethash::hash256 header;
+        ethash::hash256 boundary;
+        std::shared_ptr<CPUDataset> dataset;
+        uint64_t generation;
+    };
+
+    // A hashing thread of a grouped device and the nonces it has left
+    struct PoolThread
+    {
+        unsigned cpu;
+        std::mutex x_range;  // Guards begin, end and generation, also taken by thieves
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        uint64_t generation = 0;  // Of the job the range belongs to
+        std::atomic<uint64_t> hashes = {0};
+        double hashTimeNs = 0.0;
+        std::thread thread;
+    };
+
     atomic<bool> m_new_work = {false};
     void workLoop() override;
+    ethash::search_result searchBatch(CPUDataset& _dataset, CPUItemCache* _cache,
+        const ethash::hash256& _header, const ethash::hash256& _boundary, uint64_t _nonce,
+        size_t _count);
+    void searchAndSubmit(CPUDataset& _dataset, CPUItemCache* _cache, const ethash::hash256& _header,
+        const ethash::hash256& _boundary, const WorkPackage& _w, uint64_t _nonce, size_t _count);
+    void submitSolution(const ethash::search_result& _r, const WorkPackage& _w);
+    size_t tuneBatchSize(size_t _batch, int64_t _elapsedNs, size_t _lanes, double& _hashTimeNs);
+    void recordSwitch(int64_t _latencyNs);
     CPSettings m_settings;
+
+    // Grouped device
+    void startPool();
+    void stopPool();
+    void searchPool(const WorkPackage& w);
+    void poolLoop(unsigned _ordinal);
+    bool claimNonces(unsigned _ordinal, const PoolJob& _job, uint64_t _count, uint64_t& _nonce,
+        uint64_t& _claimed);
+    std::vector<std::unique_ptr<PoolThread>> m_pool;
+    std::shared_ptr<const PoolJob> m_poolJob;        // Atomic access
+    std::atomic<uint64_t> m_poolGeneration = {0};  // Bumped by every job switch
+    std::atomic<bool> m_poolStop = {false};
+    std::mutex x_pool;
+    std::condition_variable m_poolSignal;  // A job is published
+    std::atomic<uint64_t> m_steals = {0};
+
+    // Nonces per search batch, sized to keep job switches within the bound
+    std::atomic<unsigned> m_batchSize = {0};
+    double m_hashTimeNs = 0.0;  // Moving average of the time to hash one nonce
+
+    // Job switch latency: from kick_miner() to the search of the new job
+    std::atomic<int64_t> m_kickTime = {0};  // Steady clock, in ns
+    int64_t m_switchStart = 0;              // Kick which ended the last search
+    std::atomic<unsigned> m_switchCount = {0};
+    std::atomic<double> m_switchLastUs = {0.0};
+    std::atomic<double> m_switchAvgUs = {0.0};
+    std::atomic<double> m_switchMaxUs = {0.0};
+
+    // Light mode: one per hashing thread, the pool's in the order of m_pool
+    std::vector<std::unique_ptr<CPUItemCache>> m_itemCaches;
+
+    std::shared_ptr<CPUDataset> m_dataset;
+    std::shared_ptr<CPUDataset> m_publishedDataset;  // Read by the API thread (atomic access)
+    bool m_lanesVerified = false;
+
+    static std::vector<unsigned> s_allowedCpus;  // CPUs worth running on, within the cgroup quota
+    static std::map<int, std::vector<unsigned>> s_nodeCpus;  // Allowed CPUs by NUMA node
 };
 
 
@@ -0,0 +1,471 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* we need sched_getaffinity() */
+#endif
+#include <dirent.h>
+#include <sched.h>
+#include <sys/stat.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <libdevcore/Log.h>
+
+#include "CPUTopology.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+/*
+ * returns the CPUs this process is allowed to run on
+ */
+vector<unsigned> getAffinityCpus()
+{
+    vector<unsigned> cpus;
+#if defined(__APPLE__) || defined(__MACOSX)
+#error "TODO: Function getAffinityCpus() on MAXOSX not implemented"
+#elif defined(__linux__)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (sched_getaffinity(0, sizeof(cpuset), &cpuset) == 0)
+    {
+        for (unsigned i = 0; i < CPU_SETSIZE; i++)
+            if (CPU_ISSET(i, &cpuset))
+                cpus.push_back(i);
+    }
+#else
+    DWORD_PTR processMask, systemMask;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+    {
+        for (unsigned i = 0; i < sizeof(processMask) * 8; i++)
+            if (processMask & ((DWORD_PTR)1 << i))
+                cpus.push_back(i);
+    }
+#endif
+    return cpus;
+}
+
+/*
+ * returns the NUMA node a CPU belongs to
+ */
+int getCpuNumaNode(unsigned _cpu)
+{
+#if defined(__APPLE__) || defined(__MACOSX)
+#error "TODO: Function getCpuNumaNode() on MAXOSX not implemented"
+#elif defined(__linux__)
+    // The cpu's sysfs directory holds a "node<N>" link to its node
+    string path = "/sys/devices/system/cpu/cpu" + to_string(_cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+        return 0;
+
+    int node = 0;
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit(entry->d_name[4]))
+        {
+            node = atoi(&entry->d_name[4]);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+#else
+    PROCESSOR_NUMBER processor = {};
+    processor.Group = (WORD)(_cpu / 64);
+    processor.Number = (BYTE)(_cpu % 64);
+    USHORT node = 0;
+    if (!GetNumaProcessorNodeEx(&processor, &node))
+        return 0;
+    return node;
+#endif
+}
+
+#if defined(__linux__)
+
+const string c_cgroupRoot = "/sys/fs/cgroup";
+
+bool readLine(const string& _path, string& _line)
+{
+    ifstream f(_path);
+    return f && getline(f, _line);
+}
+
+bool exists(const string& _path)
+{
+    struct stat st;
+    return stat(_path.c_str(), &st) == 0;
+}
+
+/*
+ * Directory of a cgroup under the mount point of its hierarchy. Without
+ * a cgroup namespace a container sees the host's path while its own
+ * cgroup is mounted at the root.
+ */
+string cgroupDir(const string& _mount, const string& _path)
+{
+    const string dir = _mount + (_path == "/" ? "" : _path);
+    return exists(dir) ? dir : _mount;
+}
+
+struct Cgroup
+{
+    string dir;    // Empty if the controller is not found
+    string mount;  // Mount point of its hierarchy
+    bool v2 = false;
+};
+
+/*
+ * Finds the cgroups holding the cpuset and cpu controllers of this process
+ */
+void findCgroups(Cgroup& _cpuset, Cgroup& _cpu)
+{
+    ifstream f("/proc/self/cgroup");
+    string line;
+    string unified;
+    while (getline(f, line))
+    {
+        // hierarchy-ID:controller-list:cgroup-path
+        const size_t a = line.find(':');
+        const size_t b = line.find(':', a + 1);
+        if (a == string::npos || b == string::npos)
+            continue;
+        const string controllers = line.substr(a + 1, b - a - 1);
+        const string path = line.substr(b + 1);
+
+        if (controllers.empty())
+        {
+            unified = path;
+            continue;
+        }
+
+        // v1: one hierarchy per (set of) controllers
+        istringstream list(controllers);
+        string controller;
+        while (getline(list, controller, ','))
+        {
+            Cgroup* cg = controller == "cpuset" ? &_cpuset : controller == "cpu" ? &_cpu : nullptr;
+            if (!cg)
+                continue;
+            cg->mount = c_cgroupRoot + "/" + controllers;
+            if (!exists(cg->mount))
+                cg->mount = c_cgroupRoot + "/" + controller;
+            cg->dir = cgroupDir(cg->mount, path);
+        }
+    }
+
+    // v2: controllers not bound to a v1 hierarchy are in the unified one
+    if (!unified.empty() && exists(c_cgroupRoot + "/cgroup.controllers"))
+    {
+        for (Cgroup* cg : {&_cpuset, &_cpu})
+        {
+            if (!cg->dir.empty())
+                continue;
+            cg->mount = c_cgroupRoot;
+            cg->dir = cgroupDir(c_cgroupRoot, unified);
+            cg->v2 = true;
+        }
+    }
+}
+
+/*
+ * CPUs allowed by the cpuset controller, empty if unknown
+ */
+vector<unsigned> readCgroupCpuset(const Cgroup& _cg)
+{
+    vector<unsigned> cpus;
+    if (_cg.dir.empty())
+        return cpus;
+    string line;
+    const char* files[] = {"cpuset.cpus.effective", "cpuset.effective_cpus", "cpuset.cpus"};
+    for (const char* file : files)
+        if (readLine(_cg.dir + "/" + file, line) && parseCpuList(line, cpus) && cpus.size())
+            break;
+    return cpus;
+}
+
+/*
+ * CPUs worth of time granted by the cpu controller, 0 if unlimited.
+ * Every ancestor may set a limit, the tightest one applies.
+ */
+double readCgroupQuota(const Cgroup& _cg)
+{
+    double quota = 0.0;
+    if (_cg.dir.empty())
+        return quota;
+
+    string dir = _cg.dir;
+    while (true)
+    {
+        double limit = 0.0;
+        string line;
+        if (_cg.v2)
+        {
+            // "<quota> <period>" or "max <period>"
+            if (readLine(dir + "/cpu.max", line))
+            {
+                istringstream is(line);
+                string max;
+                double period = 0;
+                if (is >> max >> period && max != "max" && period > 0)
+                    limit = atof(max.c_str()) / period;
+            }
+        }
+        else
+        {
+            string period;
+            if (readLine(dir + "/cpu.cfs_quota_us", line) &&
+                readLine(dir + "/cpu.cfs_period_us", period) && atol(line.c_str()) > 0 &&
+                atol(period.c_str()) > 0)
+                limit = double(atol(line.c_str())) / double(atol(period.c_str()));
+        }
+        if (limit > 0.0 && (quota == 0.0 || limit < quota))
+            quota = limit;
+
+        if (dir.size() <= _cg.mount.size())
+            break;
+        dir.erase(dir.rfind('/'));
+    }
+    return quota;
+}
+
+unsigned readTopologyValue(unsigned _cpu, const char* _name)
+{
+    string line;
+    if (!readLine(
+            "/sys/devices/system/cpu/cpu" + to_string(_cpu) + "/topology/" + _name, line))
+        return _cpu;  // Unknown: a core of its own
+    return unsigned(atol(line.c_str()));
+}
+
+#endif
+
+}  // namespace
+
+
+unsigned CPUTopology::maxThreads() const
+{
+    unsigned threads = unsigned(cpus.size());
+    // A fractional CPU is worth a thread if it is at least half one
+    if (quota > 0.0)
+        threads = min(threads, max(1u, unsigned(quota + 0.5)));
+    return threads;
+}
+
+
+string CPUTopology::str() const
+{
+    ostringstream s;
+    s << cpus.size() << " logical CPUs on " << cores << " cores";
+    if (!restrictedBy.empty())
+        s << ", restricted by " << restrictedBy;
+    if (quota > 0.0)
+        s << ", cgroup quota of " << quota << " CPUs";
+    return s.str();
+}
+
+
+CPUTopology dev::eth::readCPUTopology()
+{
+    CPUTopology topology;
+    vector<unsigned> allowed = getAffinityCpus();
+
+#if defined(__linux__)
+    Cgroup cpuset, cpu;
+    findCgroups(cpuset, cpu);
+
+    // The kernel applies cpusets to the affinity mask, this only guards
+    // against a mask set wider by hand
+    vector<unsigned> cgroupCpus = readCgroupCpuset(cpuset);
+    if (cgroupCpus.size())
+    {
+        vector<unsigned> both;
+        set_intersection(allowed.begin(), allowed.end(), cgroupCpus.begin(), cgroupCpus.end(),
+            back_inserter(both));
+        if (both.size())
+            allowed.swap(both);
+    }
+    topology.quota = readCgroupQuota(cpu);
+
+    map<pair<unsigned, unsigned>, unsigned> cores;  // (package, core id) -> core
+    for (unsigned id : allowed)
+    {
+        LogicalCpu c;
+        c.id = id;
+        c.package = readTopologyValue(id, "physical_package_id");
+        auto key = make_pair(c.package, readTopologyValue(id, "core_id"));
+        auto it = cores.find(key);
+        if (it == cores.end())
+            it = cores.emplace(key, unsigned(cores.size())).first;
+        c.core = it->second;
+        c.numaNode = getCpuNumaNode(id);
+        topology.cpus.push_back(c);
+    }
+#elif defined(_WIN32)
+    // Cores and packages as masks of the logical CPUs they hold
+    map<unsigned, unsigned> coreOf, packageOf;
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(
+        length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (length && GetLogicalProcessorInformation(info.data(), &length))
+    {
+        unsigned core = 0, package = 0;
+        for (const auto& i : info)
+        {
+            map<unsigned, unsigned>* of = i.Relationship == RelationProcessorCore ?
+                                              &coreOf :
+                                              i.Relationship == RelationProcessorPackage ?
+                                              &packageOf :
+                                              nullptr;
+            if (!of)
+                continue;
+            const unsigned index = of == &coreOf ? core++ : package++;
+            for (unsigned b = 0; b < sizeof(i.ProcessorMask) * 8; b++)
+                if (i.ProcessorMask & ((ULONG_PTR)1 << b))
+                    (*of)[b] = index;
+        }
+    }
+    for (unsigned id : allowed)
+    {
+        LogicalCpu c;
+        c.id = id;
+        c.core = coreOf.count(id) ? coreOf[id] : 1000 + id;
+        c.package = packageOf.count(id) ? packageOf[id] : 0;
+        c.numaNode = getCpuNumaNode(id);
+        topology.cpus.push_back(c);
+    }
+#endif
+
+    // Rank the allowed CPUs of every core
+    map<unsigned, unsigned> perCore;
+    for (auto& c : topology.cpus)
+        c.thread = perCore[c.core]++;
+    topology.cores = unsigned(perCore.size());
+
+    // Only worth telling when it actually excludes CPUs
+    size_t online = allowed.size();
+#if defined(__linux__)
+    string line;
+    vector<unsigned> onlineCpus;
+    if (readLine("/sys/devices/system/cpu/online", line) && parseCpuList(line, onlineCpus))
+        online = onlineCpus.size();
+    if (cgroupCpus.size() && cgroupCpus.size() < online)
+        topology.restrictedBy = cpuset.v2 ? "cgroup v2 cpuset" : "cgroup v1 cpuset";
+#elif defined(_WIN32)
+    online = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#endif
+    if (topology.restrictedBy.empty() && allowed.size() < online)
+        topology.restrictedBy = "affinity mask";
+
+    return topology;
+}
+
+
+vector<LogicalCpu> dev::eth::selectCpus(
+    const CPUTopology& _topology, CPUSelectEnum _select, const vector<unsigned>& _list)
+{
+    vector<LogicalCpu> selected;
+    switch (_select)
+    {
+    case CPUSelectEnum::Physical:
+        for (const auto& c : _topology.cpus)
+            if (c.thread == 0)
+                selected.push_back(c);
+        break;
+    case CPUSelectEnum::List:
+        for (unsigned id : _list)
+        {
+            auto it = find_if(_topology.cpus.begin(), _topology.cpus.end(),
+                [id](const LogicalCpu& c) { return c.id == id; });
+            if (it == _topology.cpus.end())
+                cwarn << "CPU " << id << " is not allowed for this process, skipped";
+            else if (none_of(selected.begin(), selected.end(),
+                         [id](const LogicalCpu& c) { return c.id == id; }))
+                selected.push_back(*it);
+        }
+        break;
+    default:
+        selected = _topology.cpus;
+        break;
+    }
+
+    const unsigned maxThreads = _topology.maxThreads();
+    if (selected.size() > maxThreads)
+    {
+        if (_select == CPUSelectEnum::List)
+        {
+            cwarn << selected.size() << " CPUs listed but the cgroup quota only grants "
+                  << _topology.quota << ". Threads will be throttled";
+        }
+        else
+        {
+            // Keep one thread per core for as long as possible
+            stable_sort(selected.begin(), selected.end(),
+                [](const LogicalCpu& a, const LogicalCpu& b) { return a.thread < b.thread; });
+            selected.resize(maxThreads);
+        }
+    }
+
+    sort(selected.begin(), selected.end(),
+        [](const LogicalCpu& a, const LogicalCpu& b) { return a.id < b.id; });
+    return selected;
+}
+
+
+bool dev::eth::parseCpuList(const string& _text, vector<unsigned>& _cpus)
+{
+    vector<unsigned> cpus;
+    istringstream is(_text);
+    string range;
+    while (getline(is, range, ','))
+    {
+        range.erase(remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty())
+            continue;
+        const size_t dash = range.find('-');
+        const string first = range.substr(0, dash);
+        const string last = dash == string::npos ? first : range.substr(dash + 1);
+        if (first.empty() || last.empty() || first.size() > 6 || last.size() > 6 ||
+            !all_of(first.begin(), first.end(), ::isdigit) ||
+            !all_of(last.begin(), last.end(), ::isdigit))
+            return false;
+        const unsigned from = unsigned(stoul(first));
+        const unsigned to = unsigned(stoul(last));
+        if (to < from || to - from > 65535)
+            return false;
+        for (unsigned cpu = from; cpu <= to; cpu++)
+            cpus.push_back(cpu);
+    }
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    _cpus.swap(cpus);
+    return true;
+}
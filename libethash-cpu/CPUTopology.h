@@ -0,0 +1,83 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ CPUs the CPU miner may use, and how they share cores.
+
+ The allowed CPUs are those of the process affinity mask, further
+ restricted on Linux by the cpuset of its cgroup (v1 or v2). A cgroup
+ CPU bandwidth limit (cpu.max, or cpu.cfs_quota_us with v1) caps the
+ number of threads worth running: more would only be throttled.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <libethcore/Miner.h>
+
+namespace dev
+{
+namespace eth
+{
+struct LogicalCpu
+{
+    unsigned id = 0;       // OS CPU number
+    unsigned core = 0;     // Physical core, unique across packages
+    unsigned package = 0;  // Socket
+    int numaNode = 0;
+    unsigned thread = 0;   // Rank among the allowed CPUs of its core (0 = first)
+};
+
+struct CPUTopology
+{
+    std::vector<LogicalCpu> cpus;  // Allowed CPUs, by id
+    unsigned cores = 0;            // Physical cores with an allowed CPU
+    double quota = 0.0;            // CPUs worth of time the cgroup grants (0 = unlimited)
+    std::string restrictedBy;      // What narrowed the allowed CPUs, if anything
+
+    /**
+     * @brief Number of threads worth running: the CPUs, capped by the quota
+     */
+    unsigned maxThreads() const;
+
+    std::string str() const;
+};
+
+/**
+ * @brief Reads the allowed CPUs and their topology
+ */
+CPUTopology readCPUTopology();
+
+/**
+ * @brief Picks the CPUs to run a miner thread on, by id
+ * With a quota, threads in excess are dropped starting with SMT siblings,
+ * except for an explicit list which is only warned about. Listed CPUs
+ * that are not allowed are skipped with a warning.
+ */
+std::vector<LogicalCpu> selectCpus(
+    const CPUTopology& _topology, CPUSelectEnum _select, const std::vector<unsigned>& _list = {});
+
+/**
+ * @brief Parses a CPU list such as "0-3,8,10-11", as found in cpusets
+ * Returns false if the text is malformed.
+ */
+bool parseCpuList(const std::string& _text, std::vector<unsigned>& _cpus);
+
+}  // namespace eth
+}  // namespace dev
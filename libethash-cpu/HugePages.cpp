@@ -0,0 +1,206 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "HugePages.h"
+
+#if defined(__linux__)
+#if !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+#if !defined(MAP_HUGE_2MB)
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#if !defined(MAP_HUGE_1GB)
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+constexpr size_t c_2MiB = size_t(1) << 21;
+constexpr size_t c_1GiB = size_t(1) << 30;
+
+inline size_t roundUp(size_t _size, size_t _page)
+{
+    return (_size + _page - 1) / _page * _page;
+}
+
+#if defined(__linux__)
+/*
+ * Sets a preferred NUMA node policy on a range not yet touched.
+ * Done with the raw syscall to avoid a dependency on libnuma.
+ */
+void preferNumaNode(void* _addr, size_t _size, int _node)
+{
+    constexpr int c_mpolPreferred = 1;
+    unsigned long mask[16] = {};
+    constexpr unsigned c_maxNodes = sizeof(mask) * 8;
+    if (_node < 0 || unsigned(_node) >= c_maxNodes)
+        return;
+
+    mask[_node / (sizeof(unsigned long) * 8)] |= 1UL << (_node % (sizeof(unsigned long) * 8));
+    // Failing is harmless: pages then follow first touch
+    syscall(SYS_mbind, _addr, _size, c_mpolPreferred, mask, c_maxNodes, 0);
+}
+#endif
+
+}  // namespace
+
+
+HugePageBuffer::~HugePageBuffer()
+{
+    release();
+}
+
+
+void HugePageBuffer::release() noexcept
+{
+    if (!m_mapping)
+        return;
+#if defined(__linux__)
+    munmap(m_mapping, m_mappingSize);
+#elif defined(_WIN32)
+    VirtualFree(m_mapping, 0, MEM_RELEASE);
+#else
+    free(m_mapping);
+#endif
+    m_mapping = m_data = nullptr;
+    m_mappingSize = m_size = 0;
+    m_backing = PageBackingEnum::Normal;
+}
+
+
+void HugePageBuffer::allocate(size_t _size, PageBackingEnum _max, int _numaNode)
+{
+    release();
+
+#if defined(__linux__)
+    struct
+    {
+        PageBackingEnum backing;
+        size_t page;
+        int flags;
+    } const huge[] = {{PageBackingEnum::Huge1G, c_1GiB, MAP_HUGETLB | MAP_HUGE_1GB},
+        {PageBackingEnum::Huge2M, c_2MiB, MAP_HUGETLB | MAP_HUGE_2MB}};
+
+    for (const auto& h : huge)
+    {
+        // Don't waste more than a quarter of the buffer in page rounding
+        const size_t mappingSize = roundUp(_size, h.page);
+        if (_max < h.backing || mappingSize - _size > _size / 4)
+            continue;
+
+        void* p = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | h.flags, -1, 0);
+        if (p != MAP_FAILED)
+        {
+            m_mapping = m_data = p;
+            m_mappingSize = mappingSize;
+            m_size = _size;
+            m_backing = h.backing;
+            preferNumaNode(m_mapping, m_mappingSize, _numaNode);
+            return;
+        }
+    }
+
+    // Normal mapping, aligned on 2 MiB so that THP can back all of it
+    const size_t mappingSize = roundUp(_size, c_2MiB) + c_2MiB;
+    void* p = mmap(
+        nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        throw std::bad_alloc();
+    m_mapping = p;
+    m_mappingSize = mappingSize;
+    m_data = reinterpret_cast<void*>(roundUp(reinterpret_cast<uintptr_t>(p), c_2MiB));
+    m_size = _size;
+    m_backing = PageBackingEnum::Normal;
+    preferNumaNode(m_mapping, m_mappingSize, _numaNode);
+
+    if (_max >= PageBackingEnum::Transparent &&
+        madvise(m_data, roundUp(_size, c_2MiB), MADV_HUGEPAGE) == 0)
+        m_backing = PageBackingEnum::Transparent;
+
+#elif defined(_WIN32)
+    (void)_numaNode;
+
+    // Large pages need the "Lock pages in memory" privilege
+    const size_t largePage = GetLargePageMinimum();
+    if (_max >= PageBackingEnum::Huge2M && largePage)
+    {
+        const size_t mappingSize = roundUp(_size, largePage);
+        void* p = VirtualAlloc(
+            nullptr, mappingSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p)
+        {
+            m_mapping = m_data = p;
+            m_mappingSize = mappingSize;
+            m_size = _size;
+            m_backing = PageBackingEnum::Huge2M;
+            return;
+        }
+    }
+
+    void* p = VirtualAlloc(nullptr, _size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!p)
+        throw std::bad_alloc();
+    m_mapping = m_data = p;
+    m_mappingSize = m_size = _size;
+    m_backing = PageBackingEnum::Normal;
+
+#else
+    (void)_max;
+    (void)_numaNode;
+    void* p = calloc(1, _size);
+    if (!p)
+        throw std::bad_alloc();
+    m_mapping = m_data = p;
+    m_mappingSize = m_size = _size;
+    m_backing = PageBackingEnum::Normal;
+#endif
+}
+
+
+const char* dev::eth::pageBackingName(PageBackingEnum _backing)
+{
+    switch (_backing)
+    {
+    case PageBackingEnum::Huge1G:
+        return "1 GiB huge pages";
+    case PageBackingEnum::Huge2M:
+        return "2 MiB huge pages";
+    case PageBackingEnum::Transparent:
+        return "transparent huge pages";
+    default:
+        return "normal pages";
+    }
+}
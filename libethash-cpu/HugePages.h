@@ -0,0 +1,74 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Zeroed memory buffers backed by the largest available pages.
+
+ The DAG is read at random in 128 byte chunks: with 4 KiB pages almost
+ every read misses the TLB. Allocation tries, in order and up to the
+ requested maximum, explicit 1 GiB and 2 MiB huge pages (MAP_HUGETLB),
+ transparent huge pages (madvise) and finally normal pages.
+ Memory can be placed on a given NUMA node before it is first touched.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+#include <libethcore/Miner.h>
+
+namespace dev
+{
+namespace eth
+{
+class HugePageBuffer
+{
+public:
+    HugePageBuffer() = default;
+    ~HugePageBuffer();
+
+    HugePageBuffer(const HugePageBuffer&) = delete;
+    HugePageBuffer& operator=(const HugePageBuffer&) = delete;
+
+    /**
+     * @brief Allocates _size zeroed bytes with pages no larger than _max
+     * If _numaNode is not negative pages are preferably taken from that node.
+     * Releases any previous allocation. Throws std::bad_alloc on failure.
+     */
+    void allocate(size_t _size, PageBackingEnum _max, int _numaNode = -1);
+
+    void release() noexcept;
+
+    void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    PageBackingEnum backing() const { return m_backing; }
+
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+    void* m_mapping = nullptr;  // What has to be unmapped
+    size_t m_mappingSize = 0;
+    PageBackingEnum m_backing = PageBackingEnum::Normal;
+};
+
+/**
+ * @brief Human readable name of a page backing
+ */
+const char* pageBackingName(PageBackingEnum _backing);
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,48 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CPUKernels.h"
+#include "KeccakLanes.h"
+
+using namespace dev;
+using namespace eth;
+
+
+size_t dev::eth::keccakLanes() noexcept
+{
+    return activeCPUKernel().lanes;
+}
+
+
+void dev::eth::keccak512HeaderNonce(
+    const ethash::hash256& _header, const uint64_t* _nonces, ethash::hash512* _out) noexcept
+{
+    activeCPUKernel().keccak512HeaderNonce(_header, _nonces, _out);
+}
+
+
+void dev::eth::keccak256Final(
+    const ethash::hash512* _seeds, const ethash::hash256* _mixes, ethash::hash256* _out) noexcept
+{
+    activeCPUKernel().keccak256Final(_seeds, _mixes, _out);
+}
+
+
+const char* dev::eth::keccakLanesKernelName() noexcept
+{
+    return activeCPUKernel().name;
+}
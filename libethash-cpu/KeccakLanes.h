@@ -0,0 +1,67 @@
+/*
+This file is part of ethminer.
+
+ethminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ethminer is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ Multi-lane Keccak for the CPU ethash search path.
+
+ Every lane carries an independent Keccak state (one nonce per lane).
+ The number of lanes depends on the active kernel variant (see
+ CPUKernels.h): 8 with AVX-512, 4 otherwise.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <ethash/hash_types.hpp>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Most lanes any kernel variant processes in one call
+ */
+constexpr size_t c_maxKeccakLanes = 8;
+
+/**
+ * @brief Lanes processed by one call of the active kernel
+ */
+size_t keccakLanes() noexcept;
+
+/**
+ * @brief Keccak-512 of (header || nonce) for keccakLanes() nonces
+ * This is the ethash seed hash.
+ */
+void keccak512HeaderNonce(
+    const ethash::hash256& _header, const uint64_t* _nonces, ethash::hash512* _out) noexcept;
+
+/**
+ * @brief Keccak-256 of (seed || mix) for keccakLanes() lanes
+ * This is the ethash final hash.
+ */
+void keccak256Final(
+    const ethash::hash512* _seeds, const ethash::hash256* _mixes, ethash::hash256* _out) noexcept;
+
+/**
+ * @brief Human readable name of the active kernel variant
+ */
+const char* keccakLanesKernelName() noexcept;
+
+}  // namespace eth
+}  // namespace dev
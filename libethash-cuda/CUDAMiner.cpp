@@ -31,6 +31,21 @@ struct CUDAChannel : public LogChannel
 };
 #define cudalog clog(CUDAChannel)
 
+// Copies the DAG between the device and _host, page-locking _host for the copy
+static void copyHostDag(
+    void* _dst, const void* _src, uint64_t _size, cudaMemcpyKind _kind, void* _host)
+{
+    // Pageable memory works too, only slower
+    const bool locked =
+        cudaHostRegister(_host, size_t(_size), cudaHostRegisterDefault) == cudaSuccess;
+    if (!locked)
+        cudaGetLastError();
+    const cudaError_t result = cudaMemcpy(_dst, _src, size_t(_size), _kind);
+    if (locked)
+        cudaHostUnregister(_host);
+    CUDA_SAFE_CALL(result);
+}
+
 CUDAMiner::CUDAMiner(unsigned _index, CUSettings _settings, DeviceDescriptor& _device)
   : Miner("cuda-", _index),
     m_settings(_settings),
@@ -43,8 +58,9 @@ CUDAMiner::CUDAMiner(unsigned _index, CUSettings _settings, DeviceDescriptor& _d
 CUDAMiner::~CUDAMiner()
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cudalog, "cuda-" << m_index << " CUDAMiner::~CUDAMiner() begin");
-    stopWorking();
+    triggerStopWorking();
     kick_miner();
+    stopWorking();
     DEV_BUILD_LOG_PROGRAMFLOW(cudalog, "cuda-" << m_index << " CUDAMiner::~CUDAMiner() end");
 }
 
@@ -143,18 +159,40 @@ bool CUDAMiner::initEpoch_internal()
         set_constants(dag, m_epochContext.dagNumItems, light,
             m_epochContext.lightNumItems);  // in ethash_cuda_miner_kernel.cu
 
-        ethash_generate_dag(
-            m_epochContext.dagSize, m_settings.gridSize, m_settings.blockSize, m_streams[0]);
+        // A copy offloaded by the last standby, else a stored one
+        if (!m_hostDag.holds(m_epochContext))
+            m_hostDag.clear();
+        const bool fromHost = bool(m_hostDag.data);
+        DagStore* store = Farm::f().dagStore();
+        auto stored = store && !fromHost ? store->open(DagStoreKind::Full,
+                                               m_epochContext.epochNumber, m_epochContext.dagSize) :
+                                           nullptr;
+        if (fromHost)
+            copyHostDag(dag, m_hostDag.data.get(), m_epochContext.dagSize, cudaMemcpyHostToDevice,
+                m_hostDag.data.get());
+        else if (stored)
+            CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(dag), stored->data(),
+                stored->size(), cudaMemcpyHostToDevice));
+        else
+            ethash_generate_dag(
+                m_epochContext.dagSize, m_settings.gridSize, m_settings.blockSize, m_streams[0]);
 
         auto dag_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::steady_clock::now() - startInit)
                                 .count();
 
-        cudalog << "Generated DAG + Light in " << std::to_string(dag_duration) << " ms. "
+        cudalog << (stored ? "Loaded" : fromHost ? "Uploaded" : "Generated") << " DAG + Light in "
+                << std::to_string(dag_duration) << " ms. "
                 << dev::getFormattedMemory(
                        (double)(m_deviceDescriptor.totalMemory - RequiredMemory))
                 << " left.";
 
+        // Read the DAG back once for the next run
+        if (store && !stored && !fromHost)
+            saveDAG(*store, [&](uint8_t* _data) {
+                copyHostDag(_data, dag, m_epochContext.dagSize, cudaMemcpyDeviceToHost, _data);
+            });
+
         retVar = true;
     }
     catch (const cuda_runtime_error& ec)
@@ -174,6 +212,10 @@ void CUDAMiner::workLoop()
     WorkPackage current;
     current.header = h256();
 
+    // The newest work package, copied only when it changes
+    WorkPackage w;
+    uint64_t generation = c_noWorkGeneration;
+
     m_search_buf.resize(m_settings.streams);
     m_streams.resize(m_settings.streams);
 
@@ -184,14 +226,12 @@ void CUDAMiner::workLoop()
     {
         while (!shouldStop())
         {
-            // Wait for work or 3 seconds (whichever the first)
-            const WorkPackage w = work();
+            // Wait for work
+            if (workGeneration() != generation)
+                w = work(&generation);
             if (!w || paused())
             {
-                boost::system_time const timeout =
-                    boost::get_system_time() + boost::posix_time::seconds(3);
-                boost::mutex::scoped_lock l(x_work);
-                m_new_work_signal.timed_wait(l, timeout);
+                waitForWork(generation);
                 continue;
             }
 
@@ -226,6 +266,7 @@ void CUDAMiner::workLoop()
             uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)current.boundary >> 192);
 
             // Eventually start searching
+            workStarted(generation);
             search(current.header.data(), upper64OfBoundary, current.startNonce, w);
         }
 
@@ -243,7 +284,7 @@ void CUDAMiner::workLoop()
 void CUDAMiner::kick_miner()
 {
     m_new_work.store(true, std::memory_order_relaxed);
-    m_new_work_signal.notify_one();
+    wakeWork();
 }
 
 int CUDAMiner::getNumDevices()
@@ -326,10 +367,17 @@ void CUDAMiner::search(
         m_current_target = target;
     }
 
+    // Start nonce of the batch each stream runs, and how many of its nonces
+    // are the miner's. Batches are contiguous until the miner's range is
+    // drained, then come from the shared pool.
+    std::vector<uint64_t> stream_nonce(m_settings.streams, 0);
+    std::vector<uint64_t> stream_count(m_settings.streams, 0);
+    std::vector<bool> stream_busy(m_settings.streams, false);
+    uint64_t nonces_left = restartNonces(w, m_batch_size);
+
     // prime each stream, clear search result buffers and start the search
     uint32_t current_index;
-    for (current_index = 0; current_index < m_settings.streams;
-         current_index++, start_nonce += m_batch_size)
+    for (current_index = 0; current_index < m_settings.streams && nonces_left; current_index++)
     {
         cudaStream_t stream = m_streams[current_index];
         volatile Search_results& buffer(*m_search_buf[current_index]);
@@ -337,6 +385,10 @@ void CUDAMiner::search(
 
         // Run the batch for this stream
         run_ethash_search(m_settings.gridSize, m_settings.blockSize, stream, &buffer, start_nonce, m_settings.parallelHash);
+        stream_nonce[current_index] = start_nonce;
+        stream_count[current_index] = nonces_left;
+        stream_busy[current_index] = true;
+        nonces_left = nextNonces(w, start_nonce, m_batch_size);
     }
 
     // process stream batches until we get new work.
@@ -354,9 +406,12 @@ void CUDAMiner::search(
             done = paused();
 
         // This inner loop will process each cuda stream individually
-        for (current_index = 0; current_index < m_settings.streams;
-             current_index++, start_nonce += m_batch_size)
+        uint32_t synced = 0;
+        for (current_index = 0; current_index < m_settings.streams; current_index++)
         {
+            if (!stream_busy[current_index])
+                continue;
+
             // done if we submitted enghou solutions
             if ((m_maxSubmitCount >= 0) && (m_submitted_count >= m_maxSubmitCount))
             {
@@ -371,6 +426,8 @@ void CUDAMiner::search(
 
             // Wait for the stream complete
             CUDA_SAFE_CALL(cudaStreamSynchronize(stream));
+            stream_busy[current_index] = false;
+            synced++;
 
             if (shouldStop())
             {
@@ -385,13 +442,16 @@ void CUDAMiner::search(
             if (found_count)
             {
                 buffer.count = 0;
-                uint64_t nonce_base = start_nonce - m_streams_batch_size;
+                uint64_t nonce_base = stream_nonce[current_index];
 
                 // Extract solution and pass to higer level
                 // using io_service as dispatcher
 
                 for (uint32_t i = 0; i < found_count; i++)
                 {
+                    // The end of the batch may belong to another miner
+                    if (buffer.result[i].gid >= stream_count[current_index])
+                        continue;
                     h256 mix;
                     uint64_t nonce = nonce_base + buffer.result[i].gid;
                     memcpy(mix.data(), (void*)&buffer.result[i].mix, sizeof(buffer.result[i].mix));
@@ -410,14 +470,28 @@ void CUDAMiner::search(
             }
 
             // restart the stream on the next batch of nonces
-            // unless we are done for this round.
-            if (!done)
+            // unless we are done for this round or none are left.
+            if (!done && nonces_left)
+            {
                 run_ethash_search(
                     m_settings.gridSize, m_settings.blockSize, stream, &buffer, start_nonce, m_settings.parallelHash);
+                stream_nonce[current_index] = start_nonce;
+                stream_count[current_index] = nonces_left;
+                stream_busy[current_index] = true;
+                nonces_left = nextNonces(w, start_nonce, m_batch_size);
+            }
         }
 
         // Update the hash rate
-        updateHashRate(m_batch_size, m_settings.streams);
+        updateHashRate(m_batch_size, synced);
+
+        if (!done && !synced)
+        {
+            // Every nonce of the job is searched: wait for the next one
+            boost::mutex::scoped_lock l(x_work);
+            while (!m_new_work.load(std::memory_order_relaxed) && !shouldStop())
+                m_new_work_signal.wait(l);
+        }
 
         // Bail out if it's shutdown time
         if (shouldStop())
@@ -447,4 +521,36 @@ void CUDAMiner::clearDAG()
 
     m_allocated_memory_dag = 0;
     m_allocated_memory_light_cache = 0;
+}
+
+bool CUDAMiner::offloadDAG()
+{
+    if (!m_allocated_memory_dag)
+        return false;
+
+    if (!m_hostDag.holds(m_epochContext))
+    {
+        uint8_t* data = m_hostDag.allocate(m_epochContext.dagSize);
+        if (!data)
+        {
+            cudalog << "Not enough host memory to offload the DAG";
+            return false;
+        }
+        try
+        {
+            hash128_t* dag;
+            get_constants(&dag, NULL, NULL, NULL);
+            copyHostDag(data, dag, m_epochContext.dagSize, cudaMemcpyDeviceToHost, data);
+        }
+        catch (cuda_runtime_error const& _e)
+        {
+            cudalog << "Offloading DAG failed: " << _e.what();
+            m_hostDag.clear();
+            return false;
+        }
+        m_hostDag.epoch = m_epochContext.epochNumber;
+    }
+
+    clearDAG();
+    return true;
 }
\ No newline at end of file
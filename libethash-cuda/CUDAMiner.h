@@ -48,6 +48,8 @@ protected:
 
     bool initEpoch_internal() override;
 
+    bool offloadDAG() override;
+
     void kick_miner() override;
 
 private:
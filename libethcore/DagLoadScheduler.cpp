@@ -0,0 +1,186 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iomanip>
+
+#include <libdevcore/Log.h>
+
+#include "DagLoadScheduler.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+double msSince(chrono::steady_clock::time_point _t)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - _t).count();
+}
+}  // namespace
+
+
+void DagLoadScheduler::setLimit(unsigned _limit)
+{
+    {
+        lock_guard<mutex> l(x_devices);
+        m_limit = _limit;
+    }
+    m_released.notify_all();
+}
+
+
+unsigned DagLoadScheduler::limit() const
+{
+    lock_guard<mutex> l(x_devices);
+    return m_limit;
+}
+
+
+double DagLoadScheduler::estimateMs(Device const& _device, uint64_t _dagSize) const
+{
+    if (_device.bytesPerMs > 0.0)
+        return _dagSize / _device.bytesPerMs;
+
+    // Never generated: as fast as the average device
+    double rates = 0.0;
+    unsigned known = 0;
+    for (auto const& d : m_devices)
+    {
+        if (d.second.bytesPerMs > 0.0)
+        {
+            rates += d.second.bytesPerMs;
+            known++;
+        }
+    }
+    return known ? _dagSize / (rates / known) : 0.0;
+}
+
+
+bool DagLoadScheduler::isNext(unsigned _miner) const
+{
+    if (m_limit && m_generating >= m_limit)
+        return false;
+
+    // Shortest generation first, ties by index
+    const double estimate = m_devices.at(_miner).info.estimateMs;
+    for (auto const& d : m_devices)
+    {
+        if (d.first == _miner || d.second.info.state != DagLoadState::Queued)
+            continue;
+        if (d.second.info.estimateMs < estimate ||
+            (d.second.info.estimateMs == estimate && d.first < _miner))
+            return false;
+    }
+    return true;
+}
+
+
+bool DagLoadScheduler::acquire(
+    unsigned _miner, int _epoch, uint64_t _dagSize, function<bool()> const& _cancel)
+{
+    unique_lock<mutex> l(x_devices);
+    Device& device = m_devices[_miner];
+    device.info.state = DagLoadState::Queued;
+    device.info.epoch = _epoch;
+    device.info.estimateMs = estimateMs(device, _dagSize);
+    device.info.waitMs = 0.0;
+    device.dagSize = _dagSize;
+    device.queued = chrono::steady_clock::now();
+
+    if (!isNext(_miner))
+    {
+        cnote << "Device " << _miner << " queued for DAG generation (" << m_generating
+              << " generating, estimated " << fixed << setprecision(2)
+              << device.info.estimateMs / 1000.0 << " s)";
+        m_released.wait(l, [&]() { return isNext(_miner) || (_cancel && _cancel()); });
+    }
+    if (_cancel && _cancel())
+    {
+        // Cancelled: let the next one go
+        device.info.state = DagLoadState::Idle;
+        l.unlock();
+        m_released.notify_all();
+        return false;
+    }
+
+    device.info.state = DagLoadState::Generating;
+    device.info.waitMs = msSince(device.queued);
+    device.started = chrono::steady_clock::now();
+    m_generating++;
+    if (m_limit)
+        cnote << "Device " << _miner << " generating DAG of epoch " << _epoch << " after "
+              << fixed << setprecision(2) << device.info.waitMs / 1000.0 << " s in queue ("
+              << m_generating << "/" << m_limit << " slots)";
+    return true;
+}
+
+
+void DagLoadScheduler::release(unsigned _miner, bool _ok)
+{
+    {
+        lock_guard<mutex> l(x_devices);
+        Device& device = m_devices[_miner];
+        if (device.info.state != DagLoadState::Generating)
+            return;
+        m_generating--;
+        device.info.generationMs = msSince(device.started);
+        device.info.state = _ok ? DagLoadState::Done : DagLoadState::Failed;
+        if (_ok && device.info.generationMs > 0.0)
+            device.bytesPerMs = device.dagSize / device.info.generationMs;
+        if (m_limit)
+            cnote << "Device " << _miner << " DAG generation " << (_ok ? "done" : "failed")
+                  << " in " << fixed << setprecision(2) << device.info.generationMs / 1000.0
+                  << " s";
+    }
+    m_released.notify_all();
+}
+
+
+void DagLoadScheduler::wake()
+{
+    {
+        lock_guard<mutex> l(x_devices);
+    }
+    m_released.notify_all();
+}
+
+
+DagLoadInfo DagLoadScheduler::info(unsigned _miner) const
+{
+    lock_guard<mutex> l(x_devices);
+    auto it = m_devices.find(_miner);
+    return it == m_devices.end() ? DagLoadInfo() : it->second.info;
+}
+
+
+const char* DagLoadScheduler::stateName(DagLoadState _state)
+{
+    switch (_state)
+    {
+    case DagLoadState::Queued:
+        return "queued";
+    case DagLoadState::Generating:
+        return "generating";
+    case DagLoadState::Done:
+        return "done";
+    case DagLoadState::Failed:
+        return "failed";
+    default:
+        return "idle";
+    }
+}
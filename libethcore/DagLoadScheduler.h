@@ -0,0 +1,111 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ Limits how many devices generate their DAG at once.
+
+ A counting semaphore: up to a limit of devices generate while the others
+ queue. Queued devices are let go by increasing estimated generation time,
+ estimated from their previous generation, so that most of them start
+ hashing early. Each state change of a device is logged and kept for the
+ API.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace dev
+{
+namespace eth
+{
+enum class DagLoadState
+{
+    Idle,        // Never generated
+    Queued,      // Waiting for a slot
+    Generating,
+    Done,
+    Failed
+};
+
+struct DagLoadInfo
+{
+    DagLoadState state = DagLoadState::Idle;
+    int epoch = -1;
+    double estimateMs = 0.0;    // Of the generation, 0 if unknown
+    double waitMs = 0.0;        // Queued before generating
+    double generationMs = 0.0;  // Of the last generation
+};
+
+class DagLoadScheduler
+{
+public:
+    /**
+     * @brief Sets how many devices may generate at once, 0 for no limit
+     */
+    void setLimit(unsigned _limit);
+
+    unsigned limit() const;
+
+    /**
+     * @brief Blocks until _miner may generate the _dagSize bytes DAG of _epoch
+     * Returns false, without a slot, once _cancel returns true: it is
+     * checked on every release and wake().
+     */
+    bool acquire(unsigned _miner, int _epoch, uint64_t _dagSize,
+        std::function<bool()> const& _cancel);
+
+    /**
+     * @brief Gives back the slot of _miner, _ok telling whether its DAG is ready
+     */
+    void release(unsigned _miner, bool _ok);
+
+    /**
+     * @brief Has waiters in acquire() check their cancel condition
+     */
+    void wake();
+
+    DagLoadInfo info(unsigned _miner) const;
+
+    static const char* stateName(DagLoadState _state);
+
+private:
+    struct Device
+    {
+        DagLoadInfo info;
+        uint64_t dagSize = 0;
+        double bytesPerMs = 0.0;  // Measured by the last generation, 0 if none
+        std::chrono::steady_clock::time_point queued;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    double estimateMs(Device const& _device, uint64_t _dagSize) const;
+    bool isNext(unsigned _miner) const;
+
+    mutable std::mutex x_devices;
+    std::condition_variable m_released;
+    std::map<unsigned, Device> m_devices;
+    unsigned m_limit = 0;
+    unsigned m_generating = 0;
+};
+
+}  // namespace eth
+}  // namespace dev
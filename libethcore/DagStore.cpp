@@ -0,0 +1,438 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include <libdevcore/Log.h>
+
+#include <boost/filesystem.hpp>
+
+#include "DagStore.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+constexpr char c_magic[8] = {'E', 'T', 'H', 'D', 'A', 'G', '\0', '\0'};
+constexpr uint32_t c_version = 1;
+constexpr uint64_t c_headerSize = 4096;  // Keeps the payload page aligned
+constexpr uint64_t c_writeChunk = 64 << 20;  // Queued saves check for cancellation in between
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    int32_t epoch;
+    uint32_t reserved;
+    uint64_t payloadSize;
+    uint64_t checksum;
+};
+
+constexpr uint64_t c_checksumInit = 0xcbf29ce484222325;
+
+/*
+ * FNV-1a over 64 bit words (and trailing bytes) of the payload.
+ * When streamed, every chunk but the last must be a multiple of 8 bytes.
+ */
+uint64_t checksum(uint64_t _h, const void* _data, uint64_t _size)
+{
+    constexpr uint64_t prime = 0x100000001b3;
+    const uint8_t* p = static_cast<const uint8_t*>(_data);
+    uint64_t i = 0;
+    for (; i + 8 <= _size; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        _h = (_h ^ w) * prime;
+    }
+    for (; i < _size; i++)
+        _h = (_h ^ p[i]) * prime;
+    return _h;
+}
+
+}  // namespace
+
+
+DagStore::Mapping::~Mapping()
+{
+#if defined(_WIN32)
+    if (m_base)
+        UnmapViewOfFile(m_base);
+    if (m_fileMapping)
+        CloseHandle(m_fileMapping);
+    if (m_file)
+        CloseHandle(m_file);
+#else
+    if (m_base)
+        munmap(m_base, m_mappedSize);
+#endif
+}
+
+
+DagStore::Writer::Writer(DagStore& _store, DagStoreKind _kind, int _epoch, uint64_t _size)
+  : m_store(_store), m_kind(_kind), m_epoch(_epoch), m_size(_size), m_checksum(c_checksumInit)
+{
+    // Unique temporary name: several miners (or processes) may save the same epoch
+    static atomic<unsigned> s_sequence = {0};
+#if defined(_WIN32)
+    const unsigned long pid = GetCurrentProcessId();
+#else
+    const unsigned long pid = getpid();
+#endif
+    m_tmpPath = m_store.path(_kind, _epoch) + ".tmp" + to_string(pid) + "-" +
+                to_string(s_sequence++);
+    m_file = fopen(m_tmpPath.c_str(), "wb");
+    if (!m_file)
+        return;
+
+    // Header is rewritten with the checksum on commit
+    vector<char> header(c_headerSize, 0);
+    if (fwrite(header.data(), 1, header.size(), m_file) != header.size())
+    {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+
+DagStore::Writer::~Writer()
+{
+    if (m_file)
+    {
+        fclose(m_file);
+        boost::system::error_code ec;
+        fs::remove(m_tmpPath, ec);
+    }
+    lock_guard<mutex> l(m_store.x_store);
+    m_store.m_writing.erase(m_store.path(m_kind, m_epoch));
+}
+
+
+bool DagStore::Writer::write(const void* _data, uint64_t _size)
+{
+    if (!m_file || m_written + _size > m_size)
+        return false;
+    if (fwrite(_data, 1, _size, m_file) != _size)
+        return false;
+    m_checksum = checksum(m_checksum, _data, _size);
+    m_written += _size;
+    return true;
+}
+
+
+bool DagStore::Writer::commit()
+{
+    if (!m_file || m_written != m_size)
+        return false;
+
+    FileHeader header = {};
+    memcpy(header.magic, c_magic, sizeof(c_magic));
+    header.version = c_version;
+    header.kind = static_cast<uint32_t>(m_kind);
+    header.epoch = m_epoch;
+    header.payloadSize = m_size;
+    header.checksum = m_checksum;
+
+    bool ok = fseek(m_file, 0, SEEK_SET) == 0 &&
+              fwrite(&header, 1, sizeof(header), m_file) == sizeof(header) && fflush(m_file) == 0;
+#if !defined(_WIN32)
+    ok = ok && fsync(fileno(m_file)) == 0;
+#endif
+    ok = (fclose(m_file) == 0) && ok;
+    m_file = nullptr;
+
+    const string target = m_store.path(m_kind, m_epoch);
+    boost::system::error_code ec;
+    if (ok)
+        fs::rename(m_tmpPath, target, ec);
+    if (!ok || ec)
+    {
+        fs::remove(m_tmpPath, ec);
+        cwarn << "DAG store: unable to write " << target;
+        return false;
+    }
+
+    m_store.enforceLimit(target);
+    return true;
+}
+
+
+DagStore::DagStore(const std::string& _dir, uint64_t _maxBytes, bool _verify)
+  : m_dir(_dir), m_maxBytes(_maxBytes), m_verify(_verify)
+{
+    boost::system::error_code ec;
+    fs::create_directories(m_dir, ec);
+    if (ec)
+        cwarn << "DAG store: unable to create " << m_dir << " : " << ec.message();
+
+    // Leftovers of writes interrupted by a crash. Recent ones
+    // may belong to another instance sharing the directory.
+    const time_t stale = time(nullptr) - 600;
+    for (fs::directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        boost::system::error_code ec2;
+        if (it->path().extension().string().compare(0, 4, ".tmp") == 0 &&
+            fs::last_write_time(it->path(), ec2) < stale && !ec2)
+            fs::remove(it->path(), ec2);
+    }
+}
+
+
+DagStore::~DagStore()
+{
+    {
+        lock_guard<mutex> l(x_pending);
+        m_stopping.store(true);
+    }
+    m_pendingSignal.notify_all();
+    if (m_writerThread.joinable())
+        m_writerThread.join();
+
+    // Writers of dropped saves remove their temporary files
+    m_pending.clear();
+}
+
+
+string DagStore::path(DagStoreKind _kind, int _epoch) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "epoch-%05d.%s", _epoch,
+        _kind == DagStoreKind::Light ? "light" : "full");
+    return (fs::path(m_dir) / name).string();
+}
+
+
+bool DagStore::contains(DagStoreKind _kind, int _epoch) const
+{
+    boost::system::error_code ec;
+    return fs::exists(path(_kind, _epoch), ec);
+}
+
+
+shared_ptr<const DagStore::Mapping> DagStore::open(DagStoreKind _kind, int _epoch, uint64_t _size)
+{
+    const string file = path(_kind, _epoch);
+    boost::system::error_code ec;
+    const uint64_t fileSize = fs::file_size(file, ec);
+    if (ec)
+        return nullptr;
+
+    shared_ptr<Mapping> mapping(new Mapping());
+    mapping->m_mappedSize = fileSize;
+
+#if defined(_WIN32)
+    mapping->m_file = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mapping->m_file == INVALID_HANDLE_VALUE)
+    {
+        mapping->m_file = nullptr;
+        return nullptr;
+    }
+    mapping->m_fileMapping =
+        CreateFileMappingA(mapping->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping->m_fileMapping)
+        mapping->m_base = MapViewOfFile(mapping->m_fileMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    void* base = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base != MAP_FAILED)
+        mapping->m_base = base;
+#endif
+    if (!mapping->m_base)
+    {
+        cwarn << "DAG store: unable to map " << file;
+        return nullptr;
+    }
+
+    FileHeader header;
+    memcpy(&header, mapping->m_base, sizeof(header));
+    bool valid = fileSize >= c_headerSize && memcmp(header.magic, c_magic, sizeof(c_magic)) == 0 &&
+                 header.version == c_version && header.kind == static_cast<uint32_t>(_kind) &&
+                 header.epoch == _epoch && header.payloadSize == _size &&
+                 fileSize == c_headerSize + _size;
+    mapping->m_payload = static_cast<const uint8_t*>(mapping->m_base) + c_headerSize;
+    mapping->m_payloadSize = _size;
+
+    if (valid && m_verify)
+        valid = checksum(c_checksumInit, mapping->m_payload, _size) == header.checksum;
+
+    if (!valid)
+    {
+        cwarn << "DAG store: discarding invalid " << file;
+        mapping.reset();
+        fs::remove(file, ec);
+        return nullptr;
+    }
+
+    // Mark as recently used
+    fs::last_write_time(file, time(nullptr), ec);
+    return mapping;
+}
+
+
+unique_ptr<DagStore::Writer> DagStore::create(DagStoreKind _kind, int _epoch, uint64_t _size)
+{
+    {
+        // One writer per file is enough
+        lock_guard<mutex> l(x_store);
+        if (!m_writing.insert(path(_kind, _epoch)).second)
+            return nullptr;
+    }
+
+    unique_ptr<Writer> writer(new Writer(*this, _kind, _epoch, _size));
+    if (!writer->m_file)
+    {
+        cwarn << "DAG store: unable to create " << writer->m_tmpPath;
+        return nullptr;
+    }
+    return writer;
+}
+
+
+bool DagStore::save(DagStoreKind _kind, int _epoch, const void* _data, uint64_t _size)
+{
+    auto writer = create(_kind, _epoch, _size);
+    return writer && writer->write(_data, _size) && writer->commit();
+}
+
+
+bool DagStore::saveAsync(
+    DagStoreKind _kind, int _epoch, std::shared_ptr<const void> _data, uint64_t _size)
+{
+    auto writer = create(_kind, _epoch, _size);
+    if (!writer)
+        return false;
+    saveAsync(std::move(writer), std::move(_data));
+    return true;
+}
+
+
+void DagStore::saveAsync(std::unique_ptr<Writer> _writer, std::shared_ptr<const void> _data)
+{
+    {
+        lock_guard<mutex> l(x_pending);
+        if (m_stopping.load())
+            return;
+        PendingSave save;
+        save.writer = std::move(_writer);
+        save.data = std::move(_data);
+        m_pending.push_back(std::move(save));
+        if (!m_writerThread.joinable())
+            m_writerThread = thread(&DagStore::writeLoop, this);
+    }
+    m_pendingSignal.notify_one();
+}
+
+
+void DagStore::writeLoop()
+{
+    setThreadName("dagstore");
+    unique_lock<mutex> l(x_pending);
+    while (true)
+    {
+        m_pendingSignal.wait(l, [this]() { return m_stopping.load() || !m_pending.empty(); });
+        if (m_stopping.load())
+            return;
+        PendingSave save = std::move(m_pending.front());
+        m_pending.pop_front();
+        l.unlock();
+
+        Writer& writer = *save.writer;
+        const uint8_t* data = static_cast<const uint8_t*>(save.data.get());
+        bool ok = true;
+        for (uint64_t done = 0; ok && done < writer.m_size; done += c_writeChunk)
+            ok = !m_stopping.load() &&
+                 writer.write(data + done, min(c_writeChunk, writer.m_size - done));
+        if (ok && writer.commit())
+            cnote << (writer.m_kind == DagStoreKind::Light ? "Light cache" : "DAG") << " of epoch "
+                  << writer.m_epoch << " saved to store";
+
+        // Released outside the lock: an unfinished writer removes its file
+        save = PendingSave();
+        l.lock();
+    }
+}
+
+
+/*
+ * Removes least recently used files until the store fits its cap.
+ * The file just written is never removed.
+ */
+void DagStore::enforceLimit(const std::string& _keep)
+{
+    if (!m_maxBytes)
+        return;
+
+    lock_guard<mutex> l(x_store);
+
+    struct Entry
+    {
+        fs::path path;
+        uint64_t size;
+        time_t used;
+    };
+    vector<Entry> entries;
+    uint64_t total = 0;
+
+    boost::system::error_code ec;
+    for (fs::directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        const string ext = it->path().extension().string();
+        if (ext != ".light" && ext != ".full")
+            continue;
+        Entry e = {it->path(), fs::file_size(it->path(), ec), fs::last_write_time(it->path(), ec)};
+        if (ec)
+            continue;
+        total += e.size;
+        if (e.path.string() != _keep)
+            entries.push_back(e);
+    }
+
+    sort(entries.begin(), entries.end(),
+        [](const Entry& _a, const Entry& _b) { return _a.used < _b.used; });
+
+    for (auto const& e : entries)
+    {
+        if (total <= m_maxBytes)
+            break;
+        // Mapped files stay readable by their current users once unlinked
+        if (fs::remove(e.path, ec))
+        {
+            cnote << "DAG store: evicted " << e.path.filename().string();
+            total -= e.size;
+        }
+    }
+}
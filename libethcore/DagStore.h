@@ -0,0 +1,192 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ Persistent on-disk store of light caches and full datasets.
+
+ Files live in a single directory and are named by kind and epoch
+ (eg. "epoch-00231.light", "epoch-00231.full"). Each one starts with a
+ page sized header (magic, version, kind, epoch, payload size and a
+ checksum of the payload) followed by the raw payload, so that the
+ payload of a read-only mapping is page aligned.
+
+ Files are written to a temporary name and renamed when complete: a
+ crash never leaves a truncated file behind. Saves off the hashing and
+ job paths are queued to a single writer thread owned by the store,
+ which drops what is left of them when the store is destroyed. Opening a file refreshes
+ its modification time, which is used to evict least recently used
+ files when the store grows beyond its size cap.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace dev
+{
+namespace eth
+{
+enum class DagStoreKind
+{
+    Light,
+    Full
+};
+
+class DagStore
+{
+public:
+    /**
+     * @brief Read-only memory mapping of a stored payload
+     */
+    class Mapping
+    {
+    public:
+        ~Mapping();
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        const uint8_t* data() const { return m_payload; }
+        uint64_t size() const { return m_payloadSize; }
+
+    private:
+        friend class DagStore;
+        Mapping() = default;
+
+        void* m_base = nullptr;
+        uint64_t m_mappedSize = 0;
+        const uint8_t* m_payload = nullptr;
+        uint64_t m_payloadSize = 0;
+#if defined(_WIN32)
+        void* m_file = nullptr;
+        void* m_fileMapping = nullptr;
+#endif
+    };
+
+    /**
+     * @brief Streams a payload to the store
+     * The file becomes visible only once commit() succeeds.
+     */
+    class Writer
+    {
+    public:
+        ~Writer();
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        bool write(const void* _data, uint64_t _size);
+        bool commit();
+
+    private:
+        friend class DagStore;
+        Writer(DagStore& _store, DagStoreKind _kind, int _epoch, uint64_t _size);
+
+        DagStore& m_store;
+        DagStoreKind m_kind;
+        int m_epoch;
+        uint64_t m_size;
+        uint64_t m_written = 0;
+        uint64_t m_checksum;
+        std::string m_tmpPath;
+        std::FILE* m_file = nullptr;
+    };
+
+    /**
+     * @param _dir Directory holding the files (created if missing)
+     * @param _maxBytes Size cap of the store, 0 for no cap
+     * @param _verify Whether to verify checksums when opening files
+     */
+    DagStore(const std::string& _dir, uint64_t _maxBytes, bool _verify);
+
+    /**
+     * @brief Cancels the queued saves and joins the writer thread
+     */
+    ~DagStore();
+
+    /**
+     * @brief Maps a stored payload read-only
+     * Returns null if missing, of unexpected size or corrupted.
+     */
+    std::shared_ptr<const Mapping> open(DagStoreKind _kind, int _epoch, uint64_t _size);
+
+    /**
+     * @brief Starts writing a payload
+     * Returns null on error or if the payload is already being written.
+     */
+    std::unique_ptr<Writer> create(DagStoreKind _kind, int _epoch, uint64_t _size);
+
+    /**
+     * @brief Writes a whole payload at once
+     */
+    bool save(DagStoreKind _kind, int _epoch, const void* _data, uint64_t _size);
+
+    /**
+     * @brief Queues a whole payload to the writer thread
+     * _data is kept alive till written. False if the payload is already
+     * being written or can't be.
+     */
+    bool saveAsync(
+        DagStoreKind _kind, int _epoch, std::shared_ptr<const void> _data, uint64_t _size);
+
+    /**
+     * @brief Queues the payload of a writer from create() to the writer thread
+     * For callers that claim the payload before producing it.
+     */
+    void saveAsync(std::unique_ptr<Writer> _writer, std::shared_ptr<const void> _data);
+
+    /**
+     * @brief Whether a payload is stored (without validating it)
+     */
+    bool contains(DagStoreKind _kind, int _epoch) const;
+
+    const std::string& directory() const { return m_dir; }
+
+private:
+    struct PendingSave
+    {
+        std::unique_ptr<Writer> writer;
+        std::shared_ptr<const void> data;
+    };
+
+    std::string path(DagStoreKind _kind, int _epoch) const;
+    void enforceLimit(const std::string& _keep);
+    void writeLoop();
+
+    const std::string m_dir;
+    const uint64_t m_maxBytes;
+    const bool m_verify;
+
+    std::mutex x_store;
+    std::set<std::string> m_writing;  // Targets of uncommitted writers
+
+    std::mutex x_pending;
+    std::condition_variable m_pendingSignal;
+    std::deque<PendingSave> m_pending;
+    std::atomic<bool> m_stopping = {false};
+    std::thread m_writerThread;  // Started by the first saveAsync()
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -30,4 +30,20 @@ Result EthashAux::eval(int epoch, h256 const& _headerHash, uint64_t _nonce) noex
     h256 mix{reinterpret_cast<byte*>(result.mix_hash.bytes), h256::ConstructFromPointer};
     h256 final{reinterpret_cast<byte*>(result.final_hash.bytes), h256::ConstructFromPointer};
     return {final, mix};
-}
\ No newline at end of file
+}
+
+AlgoEnum dev::eth::algoFromName(std::string const& _name) noexcept
+{
+    return _name == "ethash" ? AlgoEnum::Ethash : AlgoEnum::Unknown;
+}
+
+const char* dev::eth::algoName(AlgoEnum _algo) noexcept
+{
+    switch (_algo)
+    {
+    case AlgoEnum::Ethash:
+        return "ethash";
+    default:
+        return "unknown";
+    }
+}
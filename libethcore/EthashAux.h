@@ -17,6 +17,9 @@
 
 #pragma once
 
+#include <cstring>
+#include <type_traits>
+
 #include <libdevcore/Common.h>
 #include <libdevcore/Exceptions.h>
 #include <libdevcore/Worker.h>
@@ -45,17 +48,69 @@ struct EpochContext
     int lightNumItems;
     size_t lightSize;
     const ethash_hash512* lightCache;
+    std::shared_ptr<const void> lightCacheOwner;  // Keeps a stored light cache mapped
     int dagNumItems;
     uint64_t dagSize;
 };
 
+// Mining algorithms, interned from the names pools use
+enum class AlgoEnum : uint8_t
+{
+    Ethash,
+    Unknown
+};
+
+AlgoEnum algoFromName(std::string const& _name) noexcept;
+const char* algoName(AlgoEnum _algo) noexcept;
+
+/**
+ * @brief Job identifier of bounded length, stored inline
+ * Can be anything, not necessarily a hash.
+ */
+class JobId
+{
+public:
+    static constexpr size_t c_capacity = 127;
+
+    /**
+     * @brief Sets the identifier. Returns false, leaving it empty, if it is too long.
+     */
+    bool assign(std::string const& _id) noexcept
+    {
+        m_size = 0;
+        if (_id.size() > c_capacity)
+            return false;
+        memcpy(m_data, _id.data(), _id.size());
+        m_size = uint8_t(_id.size());
+        return true;
+    }
+
+    void clear() noexcept { m_size = 0; }
+    bool empty() const noexcept { return m_size == 0; }
+    std::string str() const { return std::string(m_data, m_size); }
+
+    bool operator==(JobId const& _other) const noexcept
+    {
+        return m_size == _other.m_size && memcmp(m_data, _other.m_data, m_size) == 0;
+    }
+    bool operator!=(JobId const& _other) const noexcept { return !operator==(_other); }
+
+private:
+    char m_data[c_capacity];
+    uint8_t m_size = 0;
+};
+
+/**
+ * @brief Work as handed to miners
+ * Trivially copyable: copies never allocate.
+ */
 struct WorkPackage
 {
     WorkPackage() = default;
 
     explicit operator bool() const { return header != h256(); }
 
-    std::string job;  // Job identifier can be anything. Not necessarily a hash
+    JobId job;
 
     h256 boundary;
     h256 header;  ///< When h256() means "pause until notified a new work package is available".
@@ -65,9 +120,10 @@ struct WorkPackage
     int block = -1;
 
     uint64_t startNonce = 0;
+    uint64_t nonceCount = 0;  // Of the miner's range from startNonce (0 = unbounded)
     uint16_t exSizeBytes = 0;
 
-    std::string algo = "ethash";
+    AlgoEnum algo = AlgoEnum::Ethash;
 };
 
 struct Solution
@@ -79,5 +135,9 @@ struct Solution
     unsigned midx;                                 // Originating miner Id
 };
 
+static_assert(
+    std::is_trivially_copyable<WorkPackage>::value, "WorkPackage copies must not allocate");
+static_assert(std::is_trivially_copyable<Solution>::value, "Solution copies must not allocate");
+
 }  // namespace eth
 }  // namespace dev
@@ -16,6 +16,14 @@
  */
 
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <cstring>
+#include <set>
+
 #include <libethcore/Farm.h>
 
 #if ETH_ETHASHCL
@@ -34,6 +42,21 @@ namespace dev
 {
 namespace eth
 {
+namespace
+{
+// Background work must not steal time from hashing
+void setThreadIdlePriority()
+{
+#if defined(__linux__)
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#elif defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#endif
+}
+
+}  // namespace
+
 Farm* Farm::m_this = nullptr;
 
 Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
@@ -44,12 +67,35 @@ Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
     m_CPSettings(std::move(_CPSettings)),
     m_io_strand(g_io_service),
     m_collectTimer(g_io_service),
-    m_DevicesCollection(_DevicesCollection)
+    m_DevicesCollection(_DevicesCollection),
+    m_solutionCounters(_DevicesCollection.size() + 1)
 {
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "Farm::Farm() begin");
 
     m_this = this;
 
+    if (!m_Settings.dagDir.empty())
+    {
+        m_dagStore.reset(
+            new DagStore(m_Settings.dagDir, m_Settings.dagDirMax, m_Settings.dagVerify));
+        cnote << "DAG store in " << m_dagStore->directory();
+    }
+
+    if (m_Settings.historyHours)
+        m_history.reset(new TelemetryHistory(m_Settings.historyHours * 3600, m_collectInterval));
+
+    if (!m_Settings.noEval)
+    {
+        // Verified solutions go on in the order they were found
+        const unsigned threads = m_Settings.evalThreads ?
+                                     m_Settings.evalThreads :
+                                     std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+        m_verifier.reset(new SolutionVerifier(threads, [this](Solution const& _s, bool _valid) {
+            g_io_service.post(
+                m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _s, _valid)));
+        }));
+    }
+
     // Init HWMON if needed
     if (m_Settings.hwMon)
     {
@@ -149,6 +195,12 @@ Farm::Farm(std::map<std::string, DeviceDescriptor>& _DevicesCollection,
     // Initialize nonce_scrambler
     shuffle();
 
+    // Readers always find a snapshot
+    {
+        Guard l(x_minerWork);
+        publishTelemetry();
+    }
+
     // Start data collector timer
     // It should work for the whole lifetime of Farm
     // regardless it's mining state
@@ -166,6 +218,22 @@ Farm::~Farm()
     // Stop data collector (before monitors !!!)
     m_collectTimer.cancel();
 
+    // Miners submit solutions to the verifier until their threads are done
+    std::vector<std::shared_ptr<Miner>> miners = getMiners();
+    if (m_isMining.load(std::memory_order_relaxed))
+        stop();
+    for (auto const& miner : miners)
+        miner->stopWorking();
+    miners.clear();
+    m_verifier.reset();
+
+    m_precomputeCancel.store(true);
+    if (m_precomputeThread.joinable())
+        m_precomputeThread.join();
+
+    // Nothing saves anymore: drop the queued saves rather than wait on the disk
+    m_dagStore.reset();
+
     // Deinit HWMON
 #if defined(__linux)
     if (sysfsh)
@@ -177,10 +245,6 @@ Farm::~Farm()
     if (nvmlh)
         wrap_nvml_destroy(nvmlh);
 
-    // Stop mining (if needed)
-    if (m_isMining.load(std::memory_order_relaxed))
-        stop();
-
     DEV_BUILD_LOG_PROGRAMFLOW(cnote, "Farm::~Farm() end");
 }
 
@@ -197,8 +261,72 @@ void Farm::shuffle()
     m_nonce_scrambler = uniform_int_distribution<uint64_t>()(engine);
 }
 
-void Farm::setWork(WorkPackage const& _newWp)
+/*
+ * Sizes and light cache of an epoch, loaded from the DAG store if there.
+ * Otherwise the light cache is calculated: in ethash's global context
+ * (shared with solution evaluation) or, if _private, in a context owned
+ * by the returned one. Returns a null lightCache on allocation failure.
+ */
+EpochContext Farm::makeEpochContext(int _epoch, bool _private)
 {
+    EpochContext ec = {};
+    ec.epochNumber = _epoch;
+    ec.lightNumItems = ethash::calculate_light_cache_num_items(_epoch);
+    ec.lightSize = ethash::get_light_cache_size(ec.lightNumItems);
+    ec.dagNumItems = ethash::calculate_full_dataset_num_items(_epoch);
+    ec.dagSize = ethash::get_full_dataset_size(ec.dagNumItems);
+
+    // A stored light cache spares its calculation
+    if (m_dagStore)
+    {
+        auto light = m_dagStore->open(DagStoreKind::Light, _epoch, ec.lightSize);
+        if (light)
+        {
+            ec.lightCache = reinterpret_cast<const ethash_hash512*>(light->data());
+            ec.lightCacheOwner = light;
+            return ec;
+        }
+    }
+
+    if (_private)
+    {
+        std::shared_ptr<ethash::epoch_context> context = ethash::create_epoch_context(_epoch);
+        if (!context)
+            return ec;
+        ec.lightCache = context->light_cache;
+        ec.lightCacheOwner = context;
+    }
+    else
+    {
+        ec.lightCache = ethash::get_global_epoch_context(_epoch).light_cache;
+    }
+
+    if (!m_dagStore)
+        return ec;
+    if (_private)
+    {
+        // Precompute thread: nobody waits
+        m_dagStore->save(DagStoreKind::Light, _epoch, ec.lightCache, ec.lightSize);
+        return ec;
+    }
+
+    // setWork() holds x_minerWork: don't make job dispatch wait on the disk. ethash's
+    // global context may move to another epoch before the write: it gets a copy.
+    std::shared_ptr<uint8_t> copy(
+        new (std::nothrow) uint8_t[size_t(ec.lightSize)], std::default_delete<uint8_t[]>());
+    if (copy)
+    {
+        memcpy(copy.get(), ec.lightCache, size_t(ec.lightSize));
+        m_dagStore->saveAsync(DagStoreKind::Light, _epoch, std::move(copy), ec.lightSize);
+    }
+    return ec;
+}
+
+void Farm::setWork(WorkPackage const& _newWp, std::chrono::steady_clock::time_point _received)
+{
+    const auto received = std::chrono::steady_clock::now();
+    if (_received.time_since_epoch().count())
+        m_latency.workReceive.record(received - _received);
     if (paused())
     {
         resume();
@@ -211,13 +339,20 @@ void Farm::setWork(WorkPackage const& _newWp)
     // Retrieve appropriate EpochContext
     if (m_currentWp.epoch != _newWp.epoch)
     {
-        ethash::epoch_context _ec = ethash::get_global_epoch_context(_newWp.epoch);
-        m_currentEc.epochNumber = _newWp.epoch;
-        m_currentEc.lightNumItems = _ec.light_cache_num_items;
-        m_currentEc.lightSize = ethash::get_light_cache_size(_ec.light_cache_num_items);
-        m_currentEc.dagNumItems = _ec.full_dataset_num_items;
-        m_currentEc.dagSize = ethash::get_full_dataset_size(_ec.full_dataset_num_items);
-        m_currentEc.lightCache = _ec.light_cache;
+        bool prepared = false;
+        {
+            Guard lp(x_precompute);
+            if (m_nextEc.lightCache && m_nextEc.epochNumber == _newWp.epoch)
+            {
+                m_currentEc = std::move(m_nextEc);
+                m_nextEc = EpochContext();
+                prepared = true;
+            }
+        }
+        if (prepared)
+            cnote << "Switching to precomputed epoch " << _newWp.epoch;
+        else
+            m_currentEc = makeEpochContext(_newWp.epoch, false);
 
         for (auto const& miner : m_miners)
             miner->setEpoch(m_currentEc);
@@ -229,27 +364,202 @@ void Farm::setWork(WorkPackage const& _newWp)
     if (m_Settings.ergodicity == 2 && m_currentWp.exSizeBytes == 0)
         shuffle();
 
+    dispatchWork(received);
+}
+
+/**
+ * @brief Splits the nonces of the current work between miners and hands it to them
+ */
+void Farm::dispatchWork(std::chrono::steady_clock::time_point _received)
+{
     uint64_t _startNonce;
+    uint64_t _nonces;
     if (m_currentWp.exSizeBytes > 0)
     {
-        // Equally divide the residual segment among miners
+        // The residual segment is left to miners
         _startNonce = m_currentWp.startNonce;
         m_nonce_segment_with =
             (unsigned int)log2(pow(2, 64 - (m_currentWp.exSizeBytes * 4)) / m_miners.size());
+        const int bits = 64 - m_currentWp.exSizeBytes * 4;
+        _nonces = bits >= 64 ? ~uint64_t(0) : uint64_t(1) << std::max(bits, 0);
     }
     else
     {
-        // Get the randomly selected nonce
+        // Get the randomly selected nonce, followed by a segment per miner
         _startNonce = m_nonce_scrambler;
+        const uint64_t segment =
+            m_nonce_segment_with >= 64 ? ~uint64_t(0) : uint64_t(1) << m_nonce_segment_with;
+        _nonces = m_miners.empty() || segment > ~uint64_t(0) / m_miners.size() ?
+                      ~uint64_t(0) :
+                      segment * m_miners.size();
     }
 
+    // Faster miners get more nonces, paused ones none
+    m_minerRates.clear();
+    for (auto const& miner : m_miners)
+        m_minerRates.push_back(miner->paused() ? -1.0f : miner->RetrieveHashRate());
+    m_nonceAllocator.reset(m_currentWp.header, _startNonce, _nonces, m_minerRates);
+
+    // One package shared by all miners, each told which nonces are its own.
+    // A package no miner holds anymore is reused: job switches don't allocate.
+    m_currentWp.startNonce = _startNonce;
+    std::shared_ptr<WorkPackage> work;
+    for (auto const& wp : m_publishedWps)
+    {
+        if (wp.use_count() == 1)
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            work = wp;
+            break;
+        }
+    }
+    if (!work)
+    {
+        work = std::make_shared<WorkPackage>();
+        m_publishedWps.push_back(work);
+    }
+    *work = m_currentWp;
     for (unsigned int i = 0; i < m_miners.size(); i++)
     {
-        m_currentWp.startNonce = _startNonce + ((uint64_t)i << m_nonce_segment_with);
-        m_miners.at(i)->setWork(m_currentWp);
+        const NonceRange range = m_nonceAllocator.range(i);
+        m_miners.at(i)->setWork(work, range.start, range.count, _received);
     }
 }
 
+void Farm::prepareEpoch(int _epoch)
+{
+    if (_epoch < 0)
+        return;
+    {
+        Guard l(x_minerWork);
+        if (m_currentWp.epoch == _epoch)
+            return;
+    }
+
+    // Called from the pool's strand only: the thread itself needs no lock
+    if (m_precomputeEpoch == _epoch)
+        return;
+
+    m_precomputeCancel.store(true);
+    if (m_precomputeThread.joinable())
+        m_precomputeThread.join();
+
+    // Nothing saves anymore: drop the queued saves rather than wait on the disk
+    m_dagStore.reset();
+    m_precomputeCancel.store(false);
+
+    {
+        Guard l(x_precompute);
+        m_nextEc = EpochContext();
+    }
+    m_precomputeEpoch = _epoch;
+    m_precomputeThread = std::thread(&Farm::precomputeEpoch, this, _epoch);
+}
+
+void Farm::precomputeEpoch(int _epoch)
+{
+    setThreadName("precompute");
+    setThreadIdlePriority();
+
+    auto startInit = std::chrono::steady_clock::now();
+    EpochContext ec = makeEpochContext(_epoch, true);
+    if (!ec.lightCache)
+    {
+        cwarn << "Unable to precompute light cache of epoch " << _epoch;
+        return;
+    }
+    if (m_precomputeCancel.load())
+        return;
+
+    {
+        Guard l(x_precompute);
+        m_nextEc = ec;
+    }
+    cnote << "Light cache of epoch " << _epoch << " precomputed in "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - startInit)
+                 .count()
+          << " ms.";
+
+#if ETH_ETHASHCPU
+    // Light mode has no DAG
+    if (!m_CPSettings.precompute || m_CPSettings.light)
+        return;
+
+    // One dataset per NUMA node in use, as CPU miners will ask for
+    std::set<int> nodes;
+    for (auto const& d : m_DevicesCollection)
+        if (d.second.subscriptionType == DeviceSubscriptionTypeEnum::Cpu)
+            nodes.insert(m_CPSettings.numa ? d.second.cpNumaNode : -1);
+
+    // As many threads as CPU miners generating it would use
+    const unsigned threads = m_CPSettings.dagThreads ?
+                                 m_CPSettings.dagThreads :
+                                 unsigned(std::max<size_t>(CPUMiner::allowedCpus().size(), 1));
+    for (int node : nodes)
+    {
+        std::shared_ptr<CPUDataset> dataset;
+        try
+        {
+            dataset = CPUDataset::prepare(ec, m_CPSettings.pages, node, m_dagStore.get());
+        }
+        catch (const std::bad_alloc&)
+        {
+            cwarn << "Unable to allocate DAG of epoch " << _epoch << " ahead of time";
+            return;
+        }
+
+        dataset->generate(
+            threads, [](unsigned) { setThreadIdlePriority(); }, nullptr,
+            [this]() { return m_precomputeCancel.load(); });
+        if (m_precomputeCancel.load())
+            return;
+        if (m_dagStore && !dataset->fromStore())
+            dataset->save(*m_dagStore);
+    }
+    cnote << "DAG of epoch " << _epoch << " precomputed in "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - startInit)
+                 .count()
+          << " ms.";
+#endif
+}
+
+/**
+ * @brief Creates the miner of a subscribed device, null if its kind isn't built in
+ */
+std::shared_ptr<Miner> Farm::createMiner(
+    unsigned _index, DeviceDescriptor& _device, TelemetryAccountType& _telemetry)
+{
+    std::shared_ptr<Miner> miner;
+#if ETH_ETHASHCUDA
+    if (_device.subscriptionType == DeviceSubscriptionTypeEnum::Cuda)
+    {
+        _telemetry.prefix = "cu";
+        miner = std::shared_ptr<Miner>(new CUDAMiner(_index, m_CUSettings, _device));
+    }
+#endif
+#if ETH_ETHASHCL
+    if (_device.subscriptionType == DeviceSubscriptionTypeEnum::OpenCL)
+    {
+        _telemetry.prefix = "cl";
+        miner = std::shared_ptr<Miner>(new CLMiner(_index, m_CLSettings, _device));
+    }
+#endif
+#if ETH_ETHASHCPU
+    if (_device.subscriptionType == DeviceSubscriptionTypeEnum::Cpu)
+    {
+        _telemetry.prefix = "cp";
+        if (m_CPSettings.numa)
+            _telemetry.numaNode = _device.cpNumaNode;
+        miner = std::shared_ptr<Miner>(new CPUMiner(_index, m_CPSettings, _device));
+    }
+#endif
+    if (miner)
+        miner->setMaxSubmitCount(m_Settings.maxSubmitCount);
+    return miner;
+}
+
 /**
  * @brief Start a number of miners.
  */
@@ -265,44 +575,29 @@ bool Farm::start()
     // Start all subscribed miners if none yet
     if (!m_miners.size())
     {
+        // Hot-plugged miners take a slot among these: readers never see a reallocation
+        m_telemetry.miners.clear();
+        m_telemetry.miners.reserve(m_DevicesCollection.size());
+        m_miners.reserve(m_DevicesCollection.size());
         for (auto it = m_DevicesCollection.begin(); it != m_DevicesCollection.end(); it++)
         {
             TelemetryAccountType minerTelemetry;
-#if ETH_ETHASHCUDA
-            if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::Cuda)
-            {
-                minerTelemetry.prefix = "cu";
-                m_miners.push_back(std::shared_ptr<Miner>(
-                    new CUDAMiner(m_miners.size(), m_CUSettings, it->second)));
-            }
-#endif
-#if ETH_ETHASHCL
-
-            if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::OpenCL)
-            {
-                minerTelemetry.prefix = "cl";
-                m_miners.push_back(std::shared_ptr<Miner>(
-                    new CLMiner(m_miners.size(), m_CLSettings, it->second)));
-            }
-#endif
-#if ETH_ETHASHCPU
-
-            if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::Cpu)
-            {
-                minerTelemetry.prefix = "cp";
-                m_miners.push_back(std::shared_ptr<Miner>(
-                    new CPUMiner(m_miners.size(), m_CPSettings, it->second)));
-            }
-#endif
-            if (minerTelemetry.prefix.empty())
+            std::shared_ptr<Miner> miner = createMiner(m_miners.size(), it->second, minerTelemetry);
+            if (!miner)
                 continue;
+            m_miners.push_back(miner);
             m_telemetry.miners.push_back(minerTelemetry);
-            m_miners.back()->setMaxSubmitCount(m_Settings.maxSubmitCount);
-            m_miners.back()->startWorking();
+            miner->startWorking();
         }
+        for (size_t i = 0; i + 1 < m_solutionCounters.size(); i++)
+            m_solutionCounters[i].reset();
+        m_io_strand.post([this]() {
+            Guard l(x_minerWork);
+            publishTelemetry();
+        });
 
         // Initialize DAG Load mode
-        Miner::setDagLoadInfo(m_Settings.dagLoadMode, (unsigned int)m_miners.size());
+        Miner::setDagLoadLimit(m_Settings.dagLoadLimit);
 
         m_isMining.store(true, std::memory_order_relaxed);
     }
@@ -358,6 +653,22 @@ void Farm::pause()
         m->pause(MinerPauseEnum::PauseDueToFarmPaused);
 }
 
+/**
+ * @brief Pauses the whole collection of miners till the next PoW window
+ */
+void Farm::standby(DagStandbyEnum _mode)
+{
+    // Under the same lock as pause(): a resume can't come in between. The
+    // pause wakes the miners up to enter the standby
+    Guard l(x_minerWork);
+    m_paused.store(true, std::memory_order_relaxed);
+    for (auto const& m : m_miners)
+    {
+        m->standby(_mode);
+        m->pause(MinerPauseEnum::PauseDueToFarmPaused);
+    }
+}
+
 /**
  * @brief Returns whether or not this farm is paused for any reason
  */
@@ -388,6 +699,183 @@ void Farm::restart()
         m_onMinerRestart();
 }
 
+/**
+ * @brief Slot of _id: a miner index or the unique id of a device
+ * m_miners.size() for a device without a slot. Under x_minerWork.
+ */
+unsigned Farm::minerSlot(std::string const& _id)
+{
+    if (!m_isMining.load(std::memory_order_relaxed))
+        throw std::invalid_argument("Not mining");
+
+    if (!_id.empty() && std::all_of(_id.begin(), _id.end(), ::isdigit))
+    {
+        const unsigned long index = std::stoul(_id);
+        if (index >= m_miners.size())
+            throw std::invalid_argument("Index out of bounds");
+        return unsigned(index);
+    }
+
+    for (unsigned i = 0; i < m_miners.size(); i++)
+        if (m_miners[i]->getDescriptor().uniqueId == _id)
+            return i;
+    if (m_DevicesCollection.find(_id) == m_DevicesCollection.end())
+        throw std::invalid_argument("Unknown device " + _id);
+    return unsigned(m_miners.size());
+}
+
+/**
+ * @brief Splits the nonces of the current work again, after a miner was (un)plugged
+ * Under x_minerWork.
+ */
+void Farm::rebalanceWork()
+{
+    if (!m_currentWp)
+        return;
+
+    // A new scrambler keeps miners off the nonces already searched. With an
+    // extranonce the space is fixed: some may be searched twice till the next job
+    if (m_currentWp.exSizeBytes == 0)
+        shuffle();
+    dispatchWork(std::chrono::steady_clock::now());
+}
+
+/**
+ * @brief Stops a miner's thread and frees its device memory
+ */
+void Farm::unplugMiner(std::shared_ptr<Miner> const& _miner)
+{
+    _miner->triggerStopWorking();
+    _miner->kick_miner();
+    _miner->stopWorking();
+
+    // No thread uses the DAG anymore
+    _miner->clearDAG();
+}
+
+/**
+ * @brief Replaces the miner of slot _index, if any, by a new one on _device
+ */
+void Farm::plugMiner(unsigned _index, DeviceDescriptor& _device)
+{
+    // Devices never subscribed take the first backend that found them
+    if (_device.subscriptionType == DeviceSubscriptionTypeEnum::None)
+    {
+#if ETH_ETHASHCUDA
+        if (_device.cuDetected)
+            _device.subscriptionType = DeviceSubscriptionTypeEnum::Cuda;
+#endif
+#if ETH_ETHASHCL
+        if (_device.subscriptionType == DeviceSubscriptionTypeEnum::None && _device.clDetected)
+            _device.subscriptionType = DeviceSubscriptionTypeEnum::OpenCL;
+#endif
+    }
+
+    TelemetryAccountType minerTelemetry;
+    std::shared_ptr<Miner> miner = createMiner(_index, _device, minerTelemetry);
+    if (!miner)
+        throw std::invalid_argument("No miner for device " + _device.uniqueId);
+
+    std::shared_ptr<Miner> old;
+    {
+        Guard l(x_minerWork);
+        if (_index < m_miners.size())
+            old = m_miners[_index];
+        if (old && !old->pauseTest(MinerPauseEnum::PauseDueToDetached))
+        {
+            old->pause(MinerPauseEnum::PauseDueToDetached);
+            rebalanceWork();
+        }
+    }
+
+    // Stopping it may wait for its DAG generation: the others keep hashing
+    if (old)
+        unplugMiner(old);
+
+    Guard l(x_minerWork);
+    miner->setEpoch(m_currentEc);
+    if (m_paused.load(std::memory_order_relaxed))
+        miner->pause(MinerPauseEnum::PauseDueToFarmPaused);
+    if (_index < m_miners.size())
+    {
+        // Same slot: solutions are still accounted to it
+        m_miners[_index] = miner;
+        m_telemetry.miners.at(_index).hashrate = 0.0f;
+    }
+    else
+    {
+        m_miners.push_back(miner);
+        m_telemetry.miners.push_back(minerTelemetry);
+    }
+    miner->startWorking();
+    rebalanceWork();
+    m_io_strand.post([this]() {
+        Guard l(x_minerWork);
+        publishTelemetry();
+    });
+}
+
+void Farm::attachMiner(std::string const& _id)
+{
+    Guard lh(x_hotplug);
+    unsigned index;
+    DeviceDescriptor* device;
+    {
+        Guard l(x_minerWork);
+        index = minerSlot(_id);
+        if (index < m_miners.size())
+        {
+            if (!m_miners[index]->pauseTest(MinerPauseEnum::PauseDueToDetached))
+                throw std::invalid_argument("Miner " + std::to_string(index) + " is attached");
+            device = &m_DevicesCollection.at(m_miners[index]->getDescriptor().uniqueId);
+        }
+        else
+        {
+            device = &m_DevicesCollection.at(_id);
+        }
+    }
+    plugMiner(index, *device);
+    cnote << "Miner " << index << " attached to device " << device->uniqueId;
+}
+
+void Farm::detachMiner(std::string const& _id)
+{
+    Guard lh(x_hotplug);
+    unsigned index;
+    std::shared_ptr<Miner> miner;
+    {
+        Guard l(x_minerWork);
+        index = minerSlot(_id);
+        if (index == m_miners.size())
+            throw std::invalid_argument("No miner on device " + _id);
+        miner = m_miners[index];
+        if (miner->pauseTest(MinerPauseEnum::PauseDueToDetached))
+            throw std::invalid_argument("Miner " + std::to_string(index) + " is detached");
+
+        // Its nonces go to the others at once
+        miner->pause(MinerPauseEnum::PauseDueToDetached);
+        rebalanceWork();
+    }
+    unplugMiner(miner);
+    cnote << "Miner " << index << " detached";
+}
+
+void Farm::restartMiner(std::string const& _id)
+{
+    Guard lh(x_hotplug);
+    unsigned index;
+    DeviceDescriptor* device;
+    {
+        Guard l(x_minerWork);
+        index = minerSlot(_id);
+        if (index == m_miners.size())
+            throw std::invalid_argument("No miner on device " + _id);
+        device = &m_DevicesCollection.at(m_miners[index]->getDescriptor().uniqueId);
+    }
+    plugMiner(index, *device);
+    cnote << "Miner " << index << " restarted";
+}
+
 /**
  * @brief Stop all mining activities and Starts them again (async post)
  */
@@ -416,38 +904,10 @@ bool Farm::reboot(const std::vector<std::string>& args)
  */
 void Farm::accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting)
 {
-    if (_accounting == SolutionAccountingEnum::Accepted)
-    {
-        m_telemetry.farm.solutions.accepted++;
-        m_telemetry.farm.solutions.tstamp = std::chrono::steady_clock::now();
-        m_telemetry.miners.at(_minerIdx).solutions.accepted++;
-        m_telemetry.miners.at(_minerIdx).solutions.tstamp = std::chrono::steady_clock::now();
-        return;
-    }
-    if (_accounting == SolutionAccountingEnum::Wasted)
-    {
-        m_telemetry.farm.solutions.wasted++;
-        m_telemetry.farm.solutions.tstamp = std::chrono::steady_clock::now();
-        m_telemetry.miners.at(_minerIdx).solutions.wasted++;
-        m_telemetry.miners.at(_minerIdx).solutions.tstamp = std::chrono::steady_clock::now();
-        return;
-    }
-    if (_accounting == SolutionAccountingEnum::Rejected)
-    {
-        m_telemetry.farm.solutions.rejected++;
-        m_telemetry.farm.solutions.tstamp = std::chrono::steady_clock::now();
-        m_telemetry.miners.at(_minerIdx).solutions.rejected++;
-        m_telemetry.miners.at(_minerIdx).solutions.tstamp = std::chrono::steady_clock::now();
+    if (_minerIdx + 1 >= m_solutionCounters.size())
         return;
-    }
-    if (_accounting == SolutionAccountingEnum::Failed)
-    {
-        m_telemetry.farm.solutions.failed++;
-        m_telemetry.farm.solutions.tstamp = std::chrono::steady_clock::now();
-        m_telemetry.miners.at(_minerIdx).solutions.failed++;
-        m_telemetry.miners.at(_minerIdx).solutions.tstamp = std::chrono::steady_clock::now();
-        return;
-    }
+    m_solutionCounters[_minerIdx].account(_accounting);
+    m_solutionCounters.back().account(_accounting);
 }
 
 /**
@@ -456,7 +916,7 @@ void Farm::accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accountin
 
 SolutionAccountType Farm::getSolutions()
 {
-    return m_telemetry.farm.solutions;
+    return m_solutionCounters.back().load();
 }
 
 /**
@@ -464,14 +924,9 @@ SolutionAccountType Farm::getSolutions()
  */
 SolutionAccountType Farm::getSolutions(unsigned _minerIdx)
 {
-    try
-    {
-        return m_telemetry.miners.at(_minerIdx).solutions;
-    }
-    catch (const std::exception&)
-    {
+    if (_minerIdx + 1 >= m_solutionCounters.size())
         return SolutionAccountType();
-    }
+    return m_solutionCounters[_minerIdx].load();
 }
 
 /**
@@ -481,13 +936,45 @@ SolutionAccountType Farm::getSolutions(unsigned _minerIdx)
 Json::Value Farm::get_nonce_scrambler_json()
 {
     Json::Value jRes;
+    Guard l(x_minerWork);
     jRes["start_nonce"] = toHex(m_nonce_scrambler, HexPrefix::Add);
     jRes["device_width"] = m_nonce_segment_with;
     jRes["device_count"] = (uint64_t)m_miners.size();
+    jRes["allocation"] = m_nonceAllocator.json();
 
     return jRes;
 }
 
+WorkLatency Farm::getWorkLatency()
+{
+    WorkLatency latency;
+    bool first = true;
+    Guard l(x_minerWork);
+    for (auto const& miner : m_miners)
+    {
+        if (miner->paused())
+            continue;
+        const WorkLatency m = miner->workLatency();
+        latency.count = first ? m.count : std::min(latency.count, m.count);
+        latency.lastUs = std::max(latency.lastUs, m.lastUs);
+        latency.avgUs = std::max(latency.avgUs, m.avgUs);
+        latency.maxUs = std::max(latency.maxUs, m.maxUs);
+        first = false;
+    }
+    return latency;
+}
+
+bool Farm::claimNonces(
+    unsigned _minerIdx, h256 const& _header, uint64_t _min, uint64_t& _start, uint64_t& _count)
+{
+    NonceRange chunk;
+    if (!m_nonceAllocator.claim(_minerIdx, _header, _min, chunk))
+        return false;
+    _start = chunk.start;
+    _count = chunk.count;
+    return true;
+}
+
 void Farm::setTStartTStop(unsigned tstart, unsigned tstop)
 {
     m_Settings.tempStart = tstart;
@@ -501,25 +988,28 @@ void Farm::submitProof(Solution const& _s)
         pause();
         return;
     }
-    g_io_service.post(m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _s)));
+    if (m_verifier)
+        m_verifier->submit(_s);
+    else
+        g_io_service.post(
+            m_io_strand.wrap(boost::bind(&Farm::submitProofAsync, this, _s, true)));
 }
 
-void Farm::submitProofAsync(Solution const& _s)
+void Farm::submitProofAsync(Solution const& _s, bool _valid)
 {
-    if (!m_Settings.noEval)
+    if (!_valid)
     {
-        Result r = EthashAux::eval(_s.work.epoch, _s.work.header, _s.nonce);
-        if (r.value > _s.work.boundary)
-        {
-            m_submitted_count = 0;
-            accountSolution(_s.midx, SolutionAccountingEnum::Failed);
-            cwarn << "GPU " << _s.midx
-                  << " gave incorrect result. Lower overclocking values if it happens frequently.";
-            return;
-        }
+        m_submitted_count = 0;
+        accountSolution(_s.midx, SolutionAccountingEnum::Failed);
+        cwarn << "GPU " << _s.midx
+              << " gave incorrect result. Lower overclocking values if it happens frequently.";
+        return;
     }
 
+    const auto checked = std::chrono::steady_clock::now();
+    m_latency.solutionCheck.record(checked - _s.tstamp);
     m_onSolutionFound(_s);
+    m_latency.solutionSend.record(std::chrono::steady_clock::now() - checked);
 
 #ifdef DEV_BUILD
     if (g_logOptions & LOG_SUBMIT)
@@ -531,24 +1021,40 @@ void Farm::submitProofAsync(Solution const& _s)
 #endif
 }
 
+/**
+ * @brief Publishes a copy of the telemetry with the solutions accounted so far
+ * Callers hold x_minerWork, which guards m_telemetry.
+ */
+void Farm::publishTelemetry()
+{
+    for (size_t i = 0; i < m_telemetry.miners.size(); i++)
+        m_telemetry.miners[i].solutions = m_solutionCounters[i].load();
+    m_telemetry.farm.solutions = m_solutionCounters.back().load();
+    std::shared_ptr<const TelemetryType> snapshot = std::make_shared<TelemetryType>(m_telemetry);
+    std::atomic_store(&m_telemetrySnapshot, snapshot);
+}
+
 // Collects data about hashing and hardware status
 void Farm::collectData(const boost::system::error_code& ec)
 {
     if (ec)
         return;
 
-    // Reset hashrate (it will accumulate from miners)
-    float farm_hr = 0.0f;
+    // Readings are taken without the lock: sensors may be slow to answer
+    struct Reading
+    {
+        unsigned index;
+        float hashrate;
+        bool paused;
+        HwSensorsType sensors;
+    };
+    std::vector<Reading> readings;
 
     // Process miners
-    for (auto const& miner : m_miners)
+    for (auto const& miner : getMiners())
     {
-        int minerIdx = miner->Index();
-        float hr = (miner->paused() ? 0.0f : miner->RetrieveHashRate());
-        farm_hr += hr;
-        m_telemetry.miners.at(minerIdx).hashrate = hr;
-        m_telemetry.miners.at(minerIdx).paused = miner->paused();
-
+        Reading reading = {miner->Index(), 0.0f, miner->paused(), HwSensorsType()};
+        reading.hashrate = (reading.paused ? 0.0f : miner->RetrieveHashRate());
 
         if (m_Settings.hwMon)
         {
@@ -654,14 +1160,37 @@ void Farm::collectData(const boost::system::error_code& ec)
                     miner->resume(MinerPauseEnum::PauseDueToOverHeating);
             }
 
-            m_telemetry.miners.at(minerIdx).sensors.tempC = tempC;
-            m_telemetry.miners.at(minerIdx).sensors.fanP = fanpcnt;
-            m_telemetry.miners.at(minerIdx).sensors.powerW = powerW / ((double)1000.0);
+            reading.sensors.tempC = tempC;
+            reading.sensors.fanP = fanpcnt;
+            reading.sensors.powerW = powerW / ((double)1000.0);
         }
-        m_telemetry.farm.hashrate = farm_hr;
+        readings.push_back(reading);
         miner->TriggerHashRateUpdate();
     }
 
+    {
+        // Hot-plug adds miners to m_telemetry under the same lock
+        Guard l(x_minerWork);
+        float farm_hr = 0.0f;
+        m_telemetry.numaNodes.clear();
+        for (auto const& reading : readings)
+        {
+            TelemetryAccountType& account = m_telemetry.miners.at(reading.index);
+            account.hashrate = reading.hashrate;
+            account.paused = reading.paused;
+            if (m_Settings.hwMon)
+                account.sensors = reading.sensors;
+            if (account.numaNode >= 0)
+                m_telemetry.numaNodes[account.numaNode] += reading.hashrate;
+            farm_hr += reading.hashrate;
+        }
+        m_telemetry.farm.hashrate = farm_hr;
+        m_telemetry.farm.paused = paused();
+        publishTelemetry();
+    }
+    if (m_history)
+        m_history->record(*Telemetry());
+
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(
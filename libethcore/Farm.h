@@ -21,6 +21,7 @@
 #include <list>
 #include <thread>
 
+#include <boost/align/aligned_allocator.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/dll.hpp>
@@ -32,7 +33,12 @@
 #include <libdevcore/Common.h>
 #include <libdevcore/Worker.h>
 
+#include <libethcore/DagStore.h>
+#include <libethcore/LatencyHistogram.h>
 #include <libethcore/Miner.h>
+#include <libethcore/NonceAllocator.h>
+#include <libethcore/SolutionVerifier.h>
+#include <libethcore/TelemetryHistory.h>
 
 #include <libhwmon/wrapnvml.h>
 #if defined(__linux)
@@ -50,13 +56,30 @@ namespace eth
 {
 struct FarmSettings
 {
-    unsigned dagLoadMode = 0;  // 0 = Parallel; 1 = Serialized
+    unsigned dagLoadLimit = 0;  // Devices generating the DAG at once (0 = no limit)
     bool noEval = true;       // Whether or not to re-evaluate solutions
     unsigned hwMon = 0;        // 0 - No monitor; 1 - Temp and Fan; 2 - Temp Fan Power
     unsigned ergodicity = 2;   // 0=default, 1=per session, 2=per job
     unsigned tempStart = 40;   // Temperature threshold to restart mining (if paused)
     unsigned tempStop = 0;     // Temperature threshold to pause mining (overheating)
     int maxSubmitCount = 999;    // Max submissions allowed for a worker each work
+    std::string dagDir;        // Directory of the on-disk DAG store (empty = disabled)
+    uint64_t dagDirMax = 0;    // Size cap of the DAG store in bytes (0 = unlimited)
+    bool dagVerify = false;    // Whether to verify checksums of stored DAGs when loading
+    unsigned evalThreads = 0;  // Threads re-evaluating solutions (0 = auto)
+    unsigned historyHours = 24;  // Retention of the telemetry history (0 = disabled)
+};
+
+/**
+ * @brief Latency histograms of the work and solution paths, in microseconds
+ * Per device ones are kept by each Miner.
+ */
+struct FarmLatency
+{
+    LatencyHistogram workReceive;    // Work handed over by the pool -> Farm::setWork()
+    LatencyHistogram solutionCheck;  // Solution found -> checked and queued for the pool
+    LatencyHistogram solutionSend;   // Solution handed over -> sent to the pool
+    LatencyHistogram solutionAck;    // Solution sent -> accepted or rejected by the pool
 };
 
 /**
@@ -77,6 +100,16 @@ public:
 
     static Farm& f() { return *m_this; }
 
+    /**
+     * @brief Returns the on-disk DAG store, null if not configured
+     */
+    DagStore* dagStore() const { return m_dagStore.get(); }
+
+    /**
+     * @brief Returns the telemetry history, null if disabled
+     */
+    TelemetryHistory* history() const { return m_history.get(); }
+
     /**
      * @brief Randomizes the nonce scrambler
      */
@@ -85,8 +118,18 @@ public:
     /**
      * @brief Sets the current mining mission.
      * @param _wp The work package we wish to be mining.
+     * @param _received When the pool client handed the work over, if known
+     */
+    void setWork(WorkPackage const& _newWp,
+        std::chrono::steady_clock::time_point _received = std::chrono::steady_clock::time_point());
+
+    /**
+     * @brief Builds in background the epoch context of an upcoming epoch
+     * The light cache, and with --cp-precompute the CPU DAG, are built by a
+     * low priority thread so that setWork() only has to switch to them.
+     * Preparing another epoch cancels the ongoing preparation.
      */
-    void setWork(WorkPackage const& _newWp);
+    void prepareEpoch(int _epoch);
 
     /**
      * @brief Start a number of miners.
@@ -104,6 +147,12 @@ public:
      */
     void pause();
 
+    /**
+     * @brief Pauses the farm, miners putting their DAG in standby as _mode tells
+     * Between PoW windows. Resuming, or new work, wakes them up.
+     */
+    void standby(DagStandbyEnum _mode);
+
     /**
      * @brief Whether or not the whole farm has been paused
      */
@@ -119,6 +168,27 @@ public:
      */
     void restart();
 
+    /**
+     * @brief Starts a miner on a device while the others keep hashing
+     * _id is the index of a detached miner, which gets its slot back, or
+     * the unique id (PCI id for GPUs) of a device: its detached miner's or
+     * a new slot. Nonces of the current work are split again between all
+     * miners. Throws std::invalid_argument if there is nothing to attach.
+     */
+    void attachMiner(std::string const& _id);
+
+    /**
+     * @brief Stops a miner and frees its device memory, the others keep hashing
+     * _id as for attachMiner(). The miner keeps its slot, paused as detached.
+     */
+    void detachMiner(std::string const& _id);
+
+    /**
+     * @brief Replaces a miner, attached or not, by a new one on the same device
+     * _id as for attachMiner().
+     */
+    void restartMiner(std::string const& _id);
+
     /**
      * @brief Stop all mining activities and Starts them again (async post)
      */
@@ -137,24 +207,36 @@ public:
 
     /**
      * @brief Get information on the progress of mining this work package.
-     * @return The progress with mining so far.
+     * @return The progress with mining so far, as of the last collect. Never
+     * modified: hold it as long as needed.
      */
-    TelemetryType& Telemetry() { return m_telemetry; }
+    std::shared_ptr<const TelemetryType> Telemetry() const
+    {
+        return std::atomic_load(&m_telemetrySnapshot);
+    }
 
     /**
      * @brief Gets current hashrate
      */
-    float HashRate() { return m_telemetry.farm.hashrate; };
+    float HashRate() const { return Telemetry()->farm.hashrate; };
 
     /**
      * @brief Gets the collection of pointers to miner instances
      */
-    std::vector<std::shared_ptr<Miner>> getMiners() { return m_miners; }
+    std::vector<std::shared_ptr<Miner>> getMiners()
+    {
+        Guard l(x_minerWork);
+        return m_miners;
+    }
 
     /**
      * @brief Gets the number of miner instances
      */
-    unsigned getMinersCount() { return (unsigned)m_miners.size(); };
+    unsigned getMinersCount()
+    {
+        Guard l(x_minerWork);
+        return (unsigned)m_miners.size();
+    }
 
     /**
      * @brief Gets the pointer to a miner instance
@@ -163,6 +245,7 @@ public:
     {
         try
         {
+            Guard l(x_minerWork);
             return m_miners.at(index);
         }
         catch (const std::exception&)
@@ -213,17 +296,33 @@ public:
     /**
      * @brief Sets the actual start nonce of the segment picked by the farm
      */
-    void set_nonce_scrambler(uint64_t n) { m_nonce_scrambler = n; }
+    void set_nonce_scrambler(uint64_t n)
+    {
+        Guard l(x_minerWork);
+        m_nonce_scrambler = n;
+    }
 
     /**
      * @brief Sets the actual width of each subsegment assigned to miners
      */
     void set_nonce_segment_width(unsigned n)
     {
+        Guard l(x_minerWork);
         if (!m_currentWp.exSizeBytes)
             m_nonce_segment_with = n;
     }
 
+    /**
+     * @brief Gets the nonce range of the current job assigned to a miner
+     */
+    NonceRange get_nonce_range(unsigned _minerIdx) const
+    {
+        return m_nonceAllocator.range(_minerIdx);
+    }
+
+    bool claimNonces(unsigned _minerIdx, h256 const& _header, uint64_t _min, uint64_t& _start,
+        uint64_t& _count) override;
+
     /**
      * @brief Provides the description of segments each miner is working on
      * @return a JsonObject
@@ -244,21 +343,37 @@ public:
      */
     void submitProof(Solution const& _s) override;
 
-    void clearMinerDAG()
+    /**
+     * @brief Returns the metrics of solution re-evaluation
+     * All zero if solutions are not re-evaluated.
+     */
+    VerifierStats getVerifierStats() const
     {
-        for (auto const& miner : m_miners)
-            miner->clearDAG();
+        return m_verifier ? m_verifier->stats() : VerifierStats();
     }
 
+    /**
+     * @brief Time from receiving work to every miner hashing it
+     * Worst of the miners, paused ones aside.
+     */
+    WorkLatency getWorkLatency();
+
+    /**
+     * @brief Latency histograms of the work and solution paths
+     * Recorded all along, whatever the build.
+     */
+    FarmLatency& latency() { return m_latency; }
+
 private:
     std::atomic<bool> m_paused = {false};
 
     // Async submits solution serializing execution
     // in Farm's strand
-    void submitProofAsync(Solution const& _s);
+    void submitProofAsync(Solution const& _s, bool _valid);
 
     // Collects data about hashing and hardware status
     void collectData(const boost::system::error_code& ec);
+    void publishTelemetry();
 
     /**
      * @brief Spawn a file - must be located in the directory of ethminer binary
@@ -266,15 +381,31 @@ private:
      */
     bool spawn_file_in_bin_dir(const char* filename, const std::vector<std::string>& args);
 
+    EpochContext makeEpochContext(int _epoch, bool _private);
+    void precomputeEpoch(int _epoch);
+    void dispatchWork(std::chrono::steady_clock::time_point _received);
+
+    // Hot-plug of single miners
+    std::shared_ptr<Miner> createMiner(
+        unsigned _index, DeviceDescriptor& _device, TelemetryAccountType& _telemetry);
+    unsigned minerSlot(std::string const& _id);
+    void rebalanceWork();
+    void unplugMiner(std::shared_ptr<Miner> const& _miner);
+    void plugMiner(unsigned _index, DeviceDescriptor& _device);
+
     mutable Mutex x_minerWork;
-    std::vector<std::shared_ptr<Miner>> m_miners;  // Collection of miners
+    std::vector<std::shared_ptr<Miner>> m_miners;  // Collection of miners, a slot per index
+    Mutex x_hotplug;  // Serializes attach, detach and restart of single miners
 
     WorkPackage m_currentWp;
+    std::vector<std::shared_ptr<WorkPackage>> m_publishedWps;  // Recycled once miners let go
     EpochContext m_currentEc;
 
     std::atomic<bool> m_isMining = {false};
 
     TelemetryType m_telemetry;  // Holds progress and status info for farm and miners
+    std::shared_ptr<const TelemetryType> m_telemetrySnapshot;  // Atomic access
+    std::unique_ptr<TelemetryHistory> m_history;  // Samples of m_telemetry at each collect
 
     SolutionFound m_onSolutionFound;
     MinerRestart m_onMinerRestart;
@@ -284,6 +415,16 @@ private:
     CLSettings m_CLSettings;  // OpenCL settings passed to CL Miner instantiator
     CPSettings m_CPSettings;  // CPU settings passed to CPU Miner instantiator
 
+    std::unique_ptr<DagStore> m_dagStore;
+    std::unique_ptr<SolutionVerifier> m_verifier;  // Null with --noeval
+
+    // Background preparation of the next epoch
+    std::thread m_precomputeThread;
+    std::atomic<bool> m_precomputeCancel = {false};
+    int m_precomputeEpoch = -1;
+    Mutex x_precompute;          // Guards m_nextEc
+    EpochContext m_nextEc = {};  // Valid once its lightCache is set
+
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_collectTimer;
     static const int m_collectInterval = 5000;
@@ -297,8 +438,14 @@ private:
     // before it consumes the whole 2^32 segment
     uint64_t m_nonce_scrambler;
     unsigned int m_nonce_segment_with = 32;
+
+    // Splits the nonces of each job between miners by hash rate
+    NonceAllocator m_nonceAllocator;
+    std::vector<float> m_minerRates;  // Scratch of setWork()
     std::atomic<int> m_submitted_count = {0};
 
+    FarmLatency m_latency;
+
     // Wrappers for hardware monitoring libraries and their mappers
     wrap_nvml_handle* nvmlh = nullptr;
     std::map<string, int> map_nvml_handle = {};
@@ -313,6 +460,10 @@ private:
 
     static Farm* m_this;
     std::map<std::string, DeviceDescriptor>& m_DevicesCollection;
+
+    // A slot per device and the farm's last, sized once
+    std::vector<SolutionCounters, boost::alignment::aligned_allocator<SolutionCounters>>
+        m_solutionCounters;
 };
 
 }  // namespace eth
@@ -0,0 +1,108 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "LatencyHistogram.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+
+LatencyHistogram::LatencyHistogram() noexcept
+{
+    for (auto& b : m_buckets)
+        b.store(0, memory_order_relaxed);
+}
+
+
+unsigned LatencyHistogram::bucket(uint64_t _us) noexcept
+{
+    if (!_us)
+        return 0;
+
+    // Leading bit gives the power of two, the next two its quarter
+    unsigned log2 = 63;
+    while (!(_us >> log2))
+        log2--;
+    if (log2 > c_maxLog2)
+        return c_buckets - 1;
+    const unsigned sub = unsigned(
+        (log2 >= 2 ? _us >> (log2 - 2) : _us << (2 - log2)) & (c_subBuckets - 1));
+    return 1 + log2 * c_subBuckets + sub;
+}
+
+
+uint64_t LatencyHistogram::bucketEnd(unsigned _bucket) noexcept
+{
+    if (!_bucket)
+        return 0;
+    const unsigned log2 = (_bucket - 1) / c_subBuckets;
+    const uint64_t sub = (_bucket - 1) % c_subBuckets;
+    if (log2 < 2)
+        return ((c_subBuckets + sub) << log2) / c_subBuckets;  // A single value
+    return (((c_subBuckets + sub + 1) << log2) / c_subBuckets) - 1;
+}
+
+
+void LatencyHistogram::record(uint64_t _us) noexcept
+{
+    m_buckets[bucket(_us)].fetch_add(1, memory_order_relaxed);
+    m_sumUs.fetch_add(_us, memory_order_relaxed);
+    uint64_t maxUs = m_maxUs.load(memory_order_relaxed);
+    while (_us > maxUs && !m_maxUs.compare_exchange_weak(maxUs, _us, memory_order_relaxed))
+    {
+    }
+    m_count.fetch_add(1, memory_order_relaxed);
+}
+
+
+uint64_t LatencyHistogram::percentile(double _percent) const noexcept
+{
+    uint64_t counts[c_buckets];
+    uint64_t total = 0;
+    for (unsigned i = 0; i < c_buckets; i++)
+        total += counts[i] = m_buckets[i].load(memory_order_relaxed);
+    if (!total)
+        return 0;
+
+    const double rank = max(1.0, min(_percent, 100.0) / 100.0 * total);
+    uint64_t seen = 0;
+    unsigned i = 0;
+    for (; i < c_buckets - 1; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+            break;
+    }
+    return min(bucketEnd(i), m_maxUs.load(memory_order_relaxed));
+}
+
+
+Json::Value LatencyHistogram::json() const
+{
+    Json::Value jRes;
+    const uint64_t count = m_count.load(memory_order_relaxed);
+    jRes["count"] = Json::UInt64(count);
+    jRes["avg_us"] = Json::UInt64(count ? m_sumUs.load(memory_order_relaxed) / count : 0);
+    jRes["p50_us"] = Json::UInt64(percentile(50.0));
+    jRes["p90_us"] = Json::UInt64(percentile(90.0));
+    jRes["p99_us"] = Json::UInt64(percentile(99.0));
+    jRes["max_us"] = Json::UInt64(m_maxUs.load(memory_order_relaxed));
+    return jRes;
+}
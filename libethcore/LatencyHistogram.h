@@ -0,0 +1,83 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ Lock-free histogram of latencies, for percentiles of always-on metrics.
+
+ Buckets grow geometrically, four per power of two from 1 us to 2^40 us,
+ so that a percentile is known within 25 % whatever its magnitude.
+ Recording is a few relaxed atomic additions: cheap enough for hot paths
+ and safe from any thread. Readers see counts that may be a few records
+ apart, which percentiles don't mind.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <json/json.h>
+
+namespace dev
+{
+namespace eth
+{
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() noexcept;
+
+    void record(uint64_t _us) noexcept;
+
+    template <class Rep, class Period>
+    void record(std::chrono::duration<Rep, Period> _latency) noexcept
+    {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(_latency).count();
+        record(us > 0 ? uint64_t(us) : 0);
+    }
+
+    uint64_t count() const noexcept { return m_count.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Latency, in us, that _percent % of the records don't exceed
+     * The upper bound of the bucket holding it, capped by the maximum. 0
+     * if nothing was recorded.
+     */
+    uint64_t percentile(double _percent) const noexcept;
+
+    /**
+     * @brief Count, average, 50th, 90th and 99th percentiles and maximum, in us
+     */
+    Json::Value json() const;
+
+private:
+    static constexpr unsigned c_subBuckets = 4;  // Per power of two
+    static constexpr unsigned c_maxLog2 = 40;
+    static constexpr unsigned c_buckets = (c_maxLog2 + 1) * c_subBuckets + 1;  // 0 has its own
+
+    static unsigned bucket(uint64_t _us) noexcept;
+    static uint64_t bucketEnd(unsigned _bucket) noexcept;  // Highest latency of a bucket
+
+    std::atomic<uint64_t> m_buckets[c_buckets];
+    std::atomic<uint64_t> m_count = {0};
+    std::atomic<uint64_t> m_sumUs = {0};
+    std::atomic<uint64_t> m_maxUs = {0};
+};
+
+}  // namespace eth
+}  // namespace dev
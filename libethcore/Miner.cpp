@@ -15,6 +15,8 @@
  along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <thread>
+
 #include "Miner.h"
 
 namespace dev
@@ -22,9 +24,7 @@ namespace dev
 namespace eth
 {
 
-unsigned Miner::s_dagLoadMode = 0;
-unsigned Miner::s_dagLoadIndex = 0;
-unsigned Miner::s_minersCount = 0;
+DagLoadScheduler Miner::s_dagLoadScheduler;
 
 FarmFace* FarmFace::m_this = nullptr;
 
@@ -33,31 +33,43 @@ DeviceDescriptor Miner::getDescriptor()
     return m_deviceDescriptor;
 }
 
-void Miner::setWork(WorkPackage const& _work)
+void Miner::setWork(std::shared_ptr<const WorkPackage> const& _work, uint64_t _startNonce,
+    uint64_t _nonceCount, std::chrono::steady_clock::time_point _received)
 {
-    {
-
-        boost::mutex::scoped_lock l(x_work);
-
-        // Void work if this miner is paused
-        if (paused())
-            m_work.header = h256();
-        else
-            m_work = _work;
+    // Void work if this miner is paused
+    if (paused())
+        publishWork(nullptr, 0, 0, 0);
+    else
+        publishWork(_work, _startNonce, _nonceCount,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(_received.time_since_epoch())
+                .count());
 
 #ifdef DEV_BUILD
-        m_workSwitchStart = std::chrono::steady_clock::now();
+    m_workSwitchStart = std::chrono::steady_clock::now();
 #endif
-    }
 
     kick_miner();
 }
 
+void Miner::publishWork(std::shared_ptr<const WorkPackage> const& _work, uint64_t _startNonce,
+    uint64_t _nonceCount, int64_t _received)
+{
+    // Writers are the Farm and pause(): they only wait for each other
+    boost::mutex::scoped_lock l(x_workWrite);
+    m_workGeneration.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::atomic_store(&m_work, _work);
+    m_workStartNonce.store(_startNonce, std::memory_order_relaxed);
+    m_workNonceCount.store(_nonceCount, std::memory_order_relaxed);
+    m_workReceived.store(_received, std::memory_order_relaxed);
+    m_workGeneration.fetch_add(1, std::memory_order_release);
+}
+
 void Miner::pause(MinerPauseEnum what) 
 {
     boost::mutex::scoped_lock l(x_pause);
     m_pauseFlags.set(what);
-    m_work.header = h256();
+    publishWork(nullptr, 0, 0, 0);
     kick_miner();
 }
 
@@ -96,6 +108,8 @@ std::string Miner::pausedString()
                     retVar.append("Insufficient GPU memory");
                 else if (i == MinerPauseEnum::PauseDueToInitEpochError)
                     retVar.append("Epoch initialization error");
+                else if (i == MinerPauseEnum::PauseDueToDetached)
+                    retVar.append("Detached");
 
             }
         }
@@ -107,6 +121,14 @@ void Miner::resume(MinerPauseEnum fromwhat)
 {
     boost::mutex::scoped_lock l(x_pause);
     m_pauseFlags.reset(fromwhat);
+    if (fromwhat == MinerPauseEnum::PauseDueToFarmPaused)
+    {
+        // A standby not entered yet is moot
+        m_standbyRequest.store(-1, std::memory_order_relaxed);
+        m_resumeTime.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+                               .count());
+    }
     //if (!m_pauseFlags.any())
     //{
     //    // TODO Push most recent job from farm ?
@@ -133,43 +155,216 @@ void Miner::TriggerHashRateUpdate() noexcept
 
 bool Miner::initEpoch()
 {
-    // When loading of DAG is sequential wait for
-    // this instance to become current
-    if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL)
+    // Wait for a slot if the number of miners generating is limited
+    const bool scheduled = dagLoadScheduled();
+    if (scheduled &&
+        !s_dagLoadScheduler.acquire(m_index, m_epochContext.epochNumber, m_epochContext.dagSize,
+            [this]() { return shouldStop(); }))
+        return false;
+
+    // Run the internal initialization
+    // specific for miner
+    bool result = false;
+    const auto start = std::chrono::steady_clock::now();
+    try
+    {
+        result = initEpoch_internal();
+    }
+    catch (...)
+    {
+        if (scheduled)
+            s_dagLoadScheduler.release(m_index, false);
+        throw;
+    }
+
+    if (scheduled)
+        s_dagLoadScheduler.release(m_index, result);
+    if (result && !paused())
+        m_dagLoadHistogram.record(std::chrono::steady_clock::now() - start);
+    return result;
+}
+
+WorkPackage Miner::work(uint64_t* _generation) const
+{
+    while (true)
     {
-        while (s_dagLoadIndex < m_index)
+        const uint64_t generation = m_workGeneration.load(std::memory_order_acquire);
+        if (generation & 1)
         {
-            boost::system_time const timeout =
-                boost::get_system_time() + boost::posix_time::seconds(3);
-            boost::mutex::scoped_lock l(x_work);
-            m_dag_loaded_signal.timed_wait(l, timeout);
+            // Being written
+            std::this_thread::yield();
+            continue;
         }
-        if (shouldStop())
-            return false;
+        std::shared_ptr<const WorkPackage> work = std::atomic_load(&m_work);
+        const uint64_t startNonce = m_workStartNonce.load(std::memory_order_relaxed);
+        const uint64_t nonceCount = m_workNonceCount.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_workGeneration.load(std::memory_order_relaxed) != generation)
+            continue;
+
+        if (_generation)
+            *_generation = generation;
+        if (!work)
+            return WorkPackage();
+        WorkPackage w = *work;
+        w.startNonce = startNonce;
+        w.nonceCount = nonceCount;
+        return w;
     }
+}
 
-    // Run the internal initialization
-    // specific for miner
-    bool result = initEpoch_internal();
+void Miner::standby(DagStandbyEnum _mode)
+{
+    m_standbyRequest.store(int(_mode), std::memory_order_relaxed);
+}
+
+void Miner::enterStandby()
+{
+    const int mode = m_standbyRequest.exchange(-1);
+    if (mode < 0)
+        return;
 
-    // Advance to next miner or reset to zero for 
-    // next run if all have processed
-    if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL)
+    const auto start = std::chrono::steady_clock::now();
+    m_standbyMode = DagStandbyEnum(mode);
+    if (m_standbyMode == DagStandbyEnum::Host && !offloadDAG())
+        m_standbyMode = DagStandbyEnum::Resident;
+    else if (m_standbyMode == DagStandbyEnum::Clear)
+        clearDAG();
+    m_standbyTime =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+    m_inStandby = true;
+
+    if (m_standbyMode == DagStandbyEnum::Host)
+        cnote << "Standby: DAG of epoch " << m_hostDag.epoch << " offloaded to host memory in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << " ms";
+    else if (m_standbyMode == DagStandbyEnum::Resident)
+        cnote << "Standby: DAG kept in device memory";
+    else
+        cnote << "Standby: DAG cleared";
+}
+
+void Miner::waitForWork(uint64_t _generation)
+{
+    // The farm paused for a standby: this thread is the one to touch the DAG
+    if (m_standbyRequest.load(std::memory_order_relaxed) >= 0 &&
+        pauseTest(MinerPauseEnum::PauseDueToFarmPaused))
+        enterStandby();
+
+    boost::mutex::scoped_lock l(x_work);
+    while (workGeneration() == _generation && !shouldStop())
+        m_new_work_signal.wait(l);
+}
+
+void Miner::wakeWork()
+{
     {
-        s_dagLoadIndex = (m_index + 1);
-        if (s_minersCount == s_dagLoadIndex)
-            s_dagLoadIndex = 0;
-        else
-            m_dag_loaded_signal.notify_all();
+        boost::mutex::scoped_lock l(x_work);
     }
+    m_new_work_signal.notify_one();
 
-    return result;
+    // Also a stopping miner waiting for its turn to generate the DAG
+    if (shouldStop())
+        s_dagLoadScheduler.wake();
 }
 
-WorkPackage Miner::work() const
+void Miner::workStarted(uint64_t _generation) noexcept
 {
-    boost::mutex::scoped_lock l(x_work);
-    return m_work;
+    if (_generation == m_startedGeneration)
+        return;
+    m_startedGeneration = _generation;
+
+    if (m_inStandby)
+    {
+        // Time to first hash, from the farm resuming after the standby
+        m_inStandby = false;
+        const int64_t resumed = m_resumeTime.load();
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+                                .count();
+        if (resumed > m_standbyTime)
+            cnote << "First hash " << (now - resumed) / 1000000 << " ms after resuming, DAG "
+                  << (m_standbyMode == DagStandbyEnum::Resident ?
+                             "kept in device memory" :
+                             m_standbyMode == DagStandbyEnum::Host ? "uploaded from host memory" :
+                                                                     "generated again");
+    }
+
+    // Skip work voided or replaced meanwhile: the received time is another's
+    const int64_t received = m_workReceived.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!received || m_workGeneration.load(std::memory_order_relaxed) != _generation)
+        return;
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+    const double us = (now - received) / 1000.0;
+    const unsigned n = m_latencyCount.load(std::memory_order_relaxed) + 1;
+    const double avg = m_latencyAvgUs.load(std::memory_order_relaxed);
+    m_latencyAvgUs.store(n == 1 ? us : avg + (us - avg) / std::min(n, 100u));
+    m_latencyLastUs.store(us);
+    m_latencyMaxUs.store(std::max(m_latencyMaxUs.load(), us));
+    m_latencyCount.store(n);
+    m_latencyHistogram.record(uint64_t(std::max(us, 0.0)));
+}
+
+WorkLatency Miner::workLatency() const noexcept
+{
+    WorkLatency l;
+    l.count = m_latencyCount.load();
+    l.lastUs = m_latencyLastUs.load();
+    l.avgUs = m_latencyAvgUs.load();
+    l.maxUs = m_latencyMaxUs.load();
+    return l;
+}
+
+uint64_t Miner::nextNonces(WorkPackage const& _w, uint64_t& _nonce, uint64_t _count)
+{
+    _nonce += m_nonceBatch;
+    if (!_w.nonceCount)
+        return m_nonceBatch = _count;
+
+    m_noncesLeft -= m_nonceBatch;
+    m_nonceBatch = 0;
+    // Range drained: go on with a chunk of the shared pool
+    if (!m_noncesLeft &&
+        !FarmFace::f().claimNonces(m_index, _w.header, _count, _nonce, m_noncesLeft))
+        return 0;
+
+    m_nonceBatch = std::min(_count, m_noncesLeft);
+    return m_nonceBatch;
+}
+
+void Miner::saveDAG(DagStore& _store, std::function<void(uint8_t*)> const& _readBack)
+{
+    const int epoch = m_epochContext.epochNumber;
+    const uint64_t size = m_epochContext.dagSize;
+    if (_store.contains(DagStoreKind::Full, epoch))
+        return;
+
+    // Devices generating the same epoch leave it to the first one
+    std::unique_ptr<DagStore::Writer> writer = _store.create(DagStoreKind::Full, epoch, size);
+    if (!writer)
+        return;
+    std::shared_ptr<uint8_t> data(
+        new (std::nothrow) uint8_t[size_t(size)], std::default_delete<uint8_t[]>());
+    if (!data)
+    {
+        cnote << "Not enough host memory to save the DAG of epoch " << epoch;
+        return;
+    }
+    _readBack(data.get());
+    _store.saveAsync(std::move(writer), std::move(data));
+}
+
+uint64_t Miner::restartNonces(WorkPackage const& _w, uint64_t _count)
+{
+    m_noncesLeft = _w.nonceCount;
+    m_nonceBatch = _w.nonceCount ? std::min(_count, m_noncesLeft) : _count;
+    return m_nonceBatch;
 }
 
 void Miner::updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept
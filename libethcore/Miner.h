@@ -17,22 +17,30 @@
 
 #pragma once
 
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <functional>
 #include <list>
+#include <map>
+#include <memory>
+#include <new>
 #include <numeric>
 #include <string>
 
+#include "DagLoadScheduler.h"
+#include "DagStore.h"
 #include "EthashAux.h"
+#include "LatencyHistogram.h"
 #include <libdevcore/Common.h>
 #include <libdevcore/Log.h>
 #include <libdevcore/Worker.h>
 
+#include <json/json.h>
+
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
 
-#define DAG_LOAD_MODE_PARALLEL 0
-#define DAG_LOAD_MODE_SEQUENTIAL 1
-
 using namespace std;
 
 namespace dev
@@ -113,9 +121,56 @@ struct CLSettings : public MinerSettings
     unsigned localWorkSize = 128;
 };
 
+// Memory pages backing the CPU miner's DAG
+enum class PageBackingEnum
+{
+    Normal,       // Default OS pages
+    Transparent,  // Transparent huge pages requested via madvise
+    Huge2M,       // Explicit 2 MiB huge pages
+    Huge1G        // Explicit 1 GiB huge pages
+};
+
+// Instruction sets of the CPU miner's hashing kernels
+enum class CPUKernelEnum
+{
+    Auto,     // Best one the host supports
+    Generic,  // Baseline target of the build
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+// Which CPUs the CPU miner runs a thread on
+enum class CPUSelectEnum
+{
+    Logical,   // Every allowed logical CPU
+    Physical,  // One logical CPU per physical core
+    List       // CPUs given by the user
+};
+
+// How CPUs are grouped into CPU miners
+enum class CPUGroupEnum
+{
+    Cpu,     // One miner per CPU
+    Socket,  // One miner per socket, hashing on a pool of threads
+    Host     // One miner for all CPUs, hashing on a pool of threads
+};
+
 // Holds settings for CPU Miner
 struct CPSettings : public MinerSettings
 {
+    unsigned interleave = 8;  // Nonces hashed in lockstep (0 = plain lane kernels)
+    PageBackingEnum pages = PageBackingEnum::Huge1G;  // Largest pages to try for the DAG
+    bool numa = false;  // One DAG replica per NUMA node
+    unsigned dagThreads = 0;  // Threads generating the DAG (0 = all allowed CPUs)
+    bool precompute = false;  // Generate the DAG of the upcoming epoch ahead of time
+    unsigned switchLatency = 1000;  // Bound of time to switch to a new job (microseconds)
+    CPUKernelEnum kernel = CPUKernelEnum::Auto;  // Hashing kernels
+    CPUSelectEnum cpuSelect = CPUSelectEnum::Logical;
+    vector<unsigned> cpuList;  // OS CPU numbers when cpuSelect is List
+    CPUGroupEnum group = CPUGroupEnum::Cpu;
+    bool light = false;  // Calculate DAG items while hashing instead of generating the DAG
+    unsigned lightCache = 8;  // Item cache of each hashing thread in light mode (MiB)
 };
 
 struct SolutionAccountType
@@ -125,7 +180,7 @@ struct SolutionAccountType
     unsigned wasted = 0;
     unsigned failed = 0;
     std::chrono::steady_clock::time_point tstamp = std::chrono::steady_clock::now();
-    string str()
+    string str() const
     {
         string _ret = "A" + to_string(accepted);
         if (wasted)
@@ -138,12 +193,71 @@ struct SolutionAccountType
     };
 };
 
+/**
+ * @brief Solution counts of a miner, accounted by pool callbacks
+ * Alone on its cache line: miners accounting solutions don't contend with
+ * each other nor with readers.
+ */
+struct alignas(64) SolutionCounters
+{
+    std::atomic<unsigned> accepted = {0};
+    std::atomic<unsigned> rejected = {0};
+    std::atomic<unsigned> wasted = {0};
+    std::atomic<unsigned> failed = {0};
+    std::atomic<std::chrono::steady_clock::rep> tstamp;  // Of the last solution
+
+    SolutionCounters() noexcept { reset(); }
+
+    void account(SolutionAccountingEnum _accounting) noexcept
+    {
+        switch (_accounting)
+        {
+        case SolutionAccountingEnum::Accepted:
+            accepted.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SolutionAccountingEnum::Rejected:
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SolutionAccountingEnum::Wasted:
+            wasted.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SolutionAccountingEnum::Failed:
+            failed.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        tstamp.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+            std::memory_order_relaxed);
+    }
+
+    void reset() noexcept
+    {
+        accepted.store(0, std::memory_order_relaxed);
+        rejected.store(0, std::memory_order_relaxed);
+        wasted.store(0, std::memory_order_relaxed);
+        failed.store(0, std::memory_order_relaxed);
+        tstamp.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+            std::memory_order_relaxed);
+    }
+
+    SolutionAccountType load() const noexcept
+    {
+        SolutionAccountType _ret;
+        _ret.accepted = accepted.load(std::memory_order_relaxed);
+        _ret.rejected = rejected.load(std::memory_order_relaxed);
+        _ret.wasted = wasted.load(std::memory_order_relaxed);
+        _ret.failed = failed.load(std::memory_order_relaxed);
+        _ret.tstamp = std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(tstamp.load(std::memory_order_relaxed)));
+        return _ret;
+    }
+};
+
 struct HwSensorsType
 {
     int tempC = 0;
     int fanP = 0;
     double powerW = 0.0;
-    string str()
+    string str() const
     {
         string _ret = to_string(tempC) + "C " + to_string(fanP) + "%";
         if (powerW)
@@ -159,6 +273,7 @@ struct TelemetryAccountType
     bool paused = false;
     HwSensorsType sensors;
     SolutionAccountType solutions;
+    int numaNode = -1;  // Set for CPU miners in NUMA mode
 };
 
 struct DeviceDescriptor
@@ -200,6 +315,57 @@ struct DeviceDescriptor
     unsigned int cuComputeMinor;
 
     int cpCpuNumer;   // For CPU
+    int cpNumaNode;   // NUMA node of the CPU
+    vector<unsigned> cpCpus;  // All CPUs of a grouped CPU device
+};
+
+// Time from the farm receiving work to a miner hashing it
+struct WorkLatency
+{
+    unsigned count = 0;  // Work packages started
+    double lastUs = 0.0;
+    double avgUs = 0.0;  // Moving average
+    double maxUs = 0.0;
+};
+
+// What miners do with their DAG while the farm stands by between PoW windows
+enum class DagStandbyEnum
+{
+    Resident,  // Kept in device memory while the device idles
+    Host,      // Copied to host memory and freed, uploaded back on resume
+    Clear      // Freed, generated again on resume
+};
+
+// Copy of a miner's DAG in host memory, see DagStandbyEnum::Host
+struct HostDag
+{
+    int epoch = -1;  // Of the copied DAG, -1 until filled
+    uint64_t size = 0;
+    std::unique_ptr<uint8_t[]> data;
+
+    bool holds(EpochContext const& _ec) const
+    {
+        return data && epoch == _ec.epochNumber && size == _ec.dagSize;
+    }
+
+    /**
+     * @brief Replaces the copy by _size bytes to fill, null if out of memory
+     */
+    uint8_t* allocate(uint64_t _size)
+    {
+        epoch = -1;
+        data.reset();
+        data.reset(new (std::nothrow) uint8_t[size_t(_size)]);
+        size = data ? _size : 0;
+        return data.get();
+    }
+
+    void clear()
+    {
+        epoch = -1;
+        size = 0;
+        data.reset();
+    }
 };
 
 struct HwMonitorInfo
@@ -217,6 +383,7 @@ enum MinerPauseEnum
     PauseDueToFarmPaused,
     PauseDueToInsufficientMemory,
     PauseDueToInitEpochError,
+    PauseDueToDetached,
     Pause_MAX  // Must always be last as a placeholder of max count
 };
 
@@ -228,7 +395,8 @@ struct TelemetryType
 
     TelemetryAccountType farm;
     std::vector<TelemetryAccountType> miners;
-    std::string str()
+    std::map<int, float> numaNodes;  // Hashrate of CPU miners per NUMA node
+    std::string str() const
     {
         std::stringstream _ret;
 
@@ -282,7 +450,7 @@ struct TelemetryType
 
         int i = -1;                 // Current miner index
         int m = miners.size() - 1;  // Max miner index
-        for (TelemetryAccountType miner : miners)
+        for (auto const& miner : miners)
         {
             i++;
             hr = miner.hashrate;
@@ -304,6 +472,15 @@ struct TelemetryType
                 _ret << ", ";
         }
 
+        for (auto const& node : numaNodes)
+        {
+            hr = node.second;
+            if (hr > 0.0f)
+                hr /= pow(1000.0f, magnitude);
+            _ret << " - node" << node.first << " " << EthTeal << std::fixed
+                 << std::setprecision(2) << hr << EthReset;
+        }
+
         return _ret.str();
     };
 };
@@ -335,6 +512,13 @@ public:
     virtual uint64_t get_nonce_scrambler() = 0;
     virtual unsigned get_segment_width() = 0;
 
+    /**
+     * @brief Takes a chunk of at least _min nonces of job _header from the shared pool
+     * For miners done with their own range. False once the pool is drained.
+     */
+    virtual bool claimNonces(unsigned _minerIdx, h256 const& _header, uint64_t _min,
+        uint64_t& _start, uint64_t& _count) = 0;
+
 private:
     static FarmFace* m_this;
 };
@@ -353,13 +537,15 @@ public:
 
     ~Miner() override = default;
 
-    // Sets basic info for eventual serialization of DAG load
-    static void setDagLoadInfo(unsigned _mode, unsigned _devicecount)
-    {
-        s_dagLoadMode = _mode;
-        s_dagLoadIndex = 0;
-        s_minersCount = _devicecount;
-    };
+    /**
+     * @brief Sets how many miners may generate their DAG at once, 0 for no limit
+     */
+    static void setDagLoadLimit(unsigned _limit) { s_dagLoadScheduler.setLimit(_limit); }
+
+    /**
+     * @brief State and timings of this miner's DAG generation
+     */
+    DagLoadInfo dagLoadInfo() const { return s_dagLoadScheduler.info(m_index); }
 
     /**
      * @brief Gets the device descriptor assigned to this instance
@@ -368,8 +554,13 @@ public:
 
     /**
      * @brief Assigns hashing work to this instance
+     * _work is shared by all miners and never modified, this instance
+     * searches _nonceCount nonces of it from _startNonce (0 for no bound).
+     * _received is when the farm got the work, for workLatency(). Takes no
+     * lock the miner's thread may wait for.
      */
-    void setWork(WorkPackage const& _work);
+    void setWork(std::shared_ptr<const WorkPackage> const& _work, uint64_t _startNonce,
+        uint64_t _nonceCount, std::chrono::steady_clock::time_point _received);
 
     /**
      * @brief Assigns Epoch context to this instance
@@ -420,10 +611,41 @@ public:
 
     void TriggerHashRateUpdate() noexcept;
 
+    /**
+     * @brief Time from the farm receiving work to this miner hashing it
+     * Includes the DAG generation of epoch changes. Called from other threads.
+     */
+    WorkLatency workLatency() const noexcept;
+
+    /**
+     * @brief Distribution of workLatency() since the start
+     */
+    LatencyHistogram const& workLatencyHistogram() const noexcept { return m_latencyHistogram; }
+
+    /**
+     * @brief Distribution of the time taken to generate or load the DAG
+     * Waits for a slot of the DAG load scheduler aside.
+     */
+    LatencyHistogram const& dagLoadHistogram() const noexcept { return m_dagLoadHistogram; }
+
     void setMaxSubmitCount(int count) { m_maxSubmitCount = count; }
 
     virtual void clearDAG() = 0;
 
+    /**
+     * @brief Has the miner's thread put its DAG in standby as _mode tells
+     * Done once the thread idles with the farm paused, which must follow,
+     * dropped if the farm resumes first. The time to the first hash after
+     * the farm resumes is logged.
+     */
+    void standby(DagStandbyEnum _mode);
+
+    /**
+     * @brief Backend specific runtime details reported by the API
+     * Null if the backend has none. Called from other threads.
+     */
+    virtual Json::Value getDetails() { return Json::Value(); }
+
 protected:
     /**
      * @brief Initializes miner's device.
@@ -440,32 +662,97 @@ protected:
      */
     virtual bool initEpoch_internal() = 0;
 
+    /**
+     * @brief Whether initEpoch_internal() waits for a slot of the DAG load scheduler
+     */
+    virtual bool dagLoadScheduled() const { return true; }
+
+    /**
+     * @brief Saves the DAG of the current epoch to _store for the next runs
+     * _readBack copies the device DAG to the host buffer it is given. The
+     * file is written and synced by the writer thread of _store, hashing starts
+     * meanwhile. Nothing is read back if the DAG is stored or being saved
+     * already, or if host memory is short. Miner's thread only.
+     */
+    void saveDAG(DagStore& _store, std::function<void(uint8_t*)> const& _readBack);
+
+    /**
+     * @brief Copies the DAG to m_hostDag, unless it holds it already, and frees it
+     * False if the DAG is left in device memory. Miner's thread only.
+     */
+    virtual bool offloadDAG() { return false; }
+
     /**
      * @brief Returns current workpackage this miner is working on
+     * Copies it: check workGeneration() first to skip unchanged work. If
+     * not null, _generation receives the generation of the returned work.
+     */
+    WorkPackage work(uint64_t* _generation = nullptr) const;
+
+    /**
+     * @brief Changes whenever work is assigned or voided
+     * Cheap enough for the hot loop: a single atomic load.
+     */
+    uint64_t workGeneration() const noexcept
+    {
+        return m_workGeneration.load(std::memory_order_acquire);
+    }
+    static constexpr uint64_t c_noWorkGeneration = ~uint64_t(0);  // Never a workGeneration()
+
+    /**
+     * @brief Sleeps until work other than _generation is assigned or the miner stops
+     * No timeout: kick_miner() implementations end with wakeWork().
+     */
+    void waitForWork(uint64_t _generation);
+
+    /**
+     * @brief Wakes the miner's thread from waitForWork() and other waits on m_new_work_signal
+     * Cycles x_work so that a waiter can't miss a change between testing
+     * its condition and sleeping.
+     */
+    void wakeWork();
+
+    /**
+     * @brief Notes the miner started hashing work _generation, for workLatency()
+     * Only the first call for a generation counts. Miner's thread only.
+     */
+    void workStarted(uint64_t _generation) noexcept;
+
+    /**
+     * @brief Moves _nonce past the batch of _w allowed last, to the next batch of _count nonces
+     * Returns how many nonces of that batch the miner may search, less than
+     * _count at the end of its range or of a chunk: nonces past them belong
+     * to other miners. Past the range, _nonce moves to a chunk of the farm's
+     * shared pool. 0 once that is drained too. Miner's thread only.
+     */
+    uint64_t nextNonces(WorkPackage const& _w, uint64_t& _nonce, uint64_t _count);
+
+    /**
+     * @brief Starts the accounting of nextNonces() over at the startNonce of _w
+     * For every search started from there, the farm republishing the same
+     * job with a new range too. Returns how many nonces of the first batch
+     * of _count the miner may search.
      */
-    WorkPackage work() const;
+    uint64_t restartNonces(WorkPackage const& _w, uint64_t _count);
 
     void updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept;
 
-    static unsigned s_minersCount;   // Total Number of Miners
-    static unsigned s_dagLoadMode;   // Way dag should be loaded
-    static unsigned s_dagLoadIndex;  // In case of serialized load of dag this is the index of miner
-                                     // which should load next
+    static DagLoadScheduler s_dagLoadScheduler;  // Shared by all miners
 
     const unsigned m_index = 0;           // Ordinal index of the Instance (not the device)
     DeviceDescriptor m_deviceDescriptor;  // Info about the device
 
     EpochContext m_epochContext;
+    HostDag m_hostDag;  // Miner's thread only
 
 #ifdef DEV_BUILD
     std::chrono::steady_clock::time_point m_workSwitchStart;
 #endif
 
     HwMonitorInfo m_hwmoninfo;
-    mutable boost::mutex x_work;
+    mutable boost::mutex x_work;  // Guards waits on m_new_work_signal
     mutable boost::mutex x_pause;
     boost::condition_variable m_new_work_signal;
-    boost::condition_variable m_dag_loaded_signal;
 
     /**
      * @brief -1 allow all solutions
@@ -475,7 +762,36 @@ protected:
 private:
     bitset<MinerPauseEnum::Pause_MAX> m_pauseFlags;
 
-    WorkPackage m_work;
+    // Work slot, a seqlock: the generation is odd while being written
+    void publishWork(std::shared_ptr<const WorkPackage> const& _work, uint64_t _startNonce,
+        uint64_t _nonceCount, int64_t _received);
+    std::shared_ptr<const WorkPackage> m_work;  // Atomic access. Null when voided
+    std::atomic<uint64_t> m_workStartNonce = {0};
+    std::atomic<uint64_t> m_workNonceCount = {0};
+    std::atomic<int64_t> m_workReceived = {0};  // Steady clock at the farm, in ns
+    std::atomic<uint64_t> m_workGeneration = {0};
+    boost::mutex x_workWrite;
+
+    // Written by the miner's thread only
+    uint64_t m_startedGeneration = c_noWorkGeneration;
+    std::atomic<unsigned> m_latencyCount = {0};
+    std::atomic<double> m_latencyLastUs = {0.0};
+    std::atomic<double> m_latencyAvgUs = {0.0};
+    std::atomic<double> m_latencyMaxUs = {0.0};
+    LatencyHistogram m_latencyHistogram;
+    LatencyHistogram m_dagLoadHistogram;
+
+    // Standby between PoW windows
+    void enterStandby();
+    std::atomic<int> m_standbyRequest = {-1};  // DagStandbyEnum to enter, -1 for none
+    std::atomic<int64_t> m_resumeTime = {0};   // Steady clock of the farm resuming, in ns
+    int64_t m_standbyTime = 0;                 // Steady clock of entering it, in ns
+    bool m_inStandby = false;                  // Miner's thread only, till the first hash
+    DagStandbyEnum m_standbyMode = DagStandbyEnum::Resident;  // The one entered
+
+    // Nonces left in the range or chunk from the batch allowed last, and its size
+    uint64_t m_noncesLeft = 0;
+    uint64_t m_nonceBatch = 0;
 
     std::chrono::steady_clock::time_point m_hashTime = std::chrono::steady_clock::now();
     std::atomic<float> m_hashRate = {0.0};
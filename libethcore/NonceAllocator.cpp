@@ -0,0 +1,142 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <libdevcore/CommonData.h>
+
+#include "NonceAllocator.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+
+void NonceAllocator::reset(
+    h256 const& _header, uint64_t _start, uint64_t _count, vector<float> const& _hashRates)
+{
+    const size_t miners = _hashRates.size();
+
+    lock_guard<mutex> l(x_ranges);
+
+    // Miners without a rate yet are assumed average, those not mining get nothing
+    double known = 0.0;
+    size_t rated = 0;
+    for (float rate : _hashRates)
+    {
+        if (rate > 0.0f)
+        {
+            known += rate;
+            rated++;
+        }
+    }
+    const double average = rated ? known / rated : 1.0;
+    double total = 0.0;
+    m_weights.assign(miners, 0.0);
+    for (size_t i = 0; i < miners; i++)
+    {
+        if (_hashRates[i] >= 0.0f)
+            m_weights[i] = _hashRates[i] > 0.0f ? _hashRates[i] : average;
+        total += m_weights[i];
+    }
+    if (total <= 0.0)
+    {
+        m_weights.assign(miners, 1.0);
+        total = double(miners);
+    }
+
+    m_header = _header;
+    m_hashRates = _hashRates;
+    m_ranges.assign(miners, NonceRange());
+    m_claimed.assign(miners, 0);
+    m_chunks.assign(miners, 0);
+
+    const uint64_t pool = miners ? _count / c_poolDivisor : 0;
+    const uint64_t shared = _count - pool;
+    uint64_t next = _start;
+    uint64_t left = shared;
+    for (size_t i = 0; i < miners; i++)
+    {
+        // A count of 0 would mean unbounded to a mining miner
+        uint64_t count = min(left, uint64_t((long double)shared * m_weights[i] / total));
+        if (!count && m_weights[i] > 0.0 && left)
+            count = 1;
+        m_ranges[i].start = next;
+        m_ranges[i].count = count;
+        next += count;
+        left -= count;
+    }
+
+    // Rounding remainders go to the pool
+    m_pool.start = next;
+    m_pool.count = pool + left;
+    m_poolUsed = 0;
+    m_chunkSize = miners ? max<uint64_t>(m_pool.count / (c_chunkDivisor * miners), 1) : 0;
+}
+
+
+NonceRange NonceAllocator::range(unsigned _miner) const
+{
+    lock_guard<mutex> l(x_ranges);
+    if (_miner >= m_ranges.size())
+        return NonceRange();
+    return m_ranges[_miner];
+}
+
+
+bool NonceAllocator::claim(unsigned _miner, h256 const& _header, uint64_t _min, NonceRange& _chunk)
+{
+    lock_guard<mutex> l(x_ranges);
+    if (_header != m_header || _miner >= m_ranges.size() || m_poolUsed >= m_pool.count)
+        return false;
+
+    _chunk.start = m_pool.start + m_poolUsed;
+    _chunk.count = min(max(_min, m_chunkSize), m_pool.count - m_poolUsed);
+    m_poolUsed += _chunk.count;
+    m_claimed[_miner] += _chunk.count;
+    m_chunks[_miner]++;
+    return true;
+}
+
+
+Json::Value NonceAllocator::json() const
+{
+    lock_guard<mutex> l(x_ranges);
+    Json::Value jRes;
+
+    Json::Value jMiners = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < m_ranges.size(); i++)
+    {
+        Json::Value jMiner;
+        jMiner["start_nonce"] = toHex(m_ranges[i].start, HexPrefix::Add);
+        jMiner["count"] = Json::UInt64(m_ranges[i].count);
+        jMiner["hashrate"] = m_hashRates[i];
+        jMiner["pool_chunks"] = m_chunks[i];
+        jMiner["pool_nonces"] = Json::UInt64(m_claimed[i]);
+        jMiners.append(jMiner);
+    }
+    jRes["devices"] = jMiners;
+
+    Json::Value jPool;
+    jPool["start_nonce"] = toHex(m_pool.start, HexPrefix::Add);
+    jPool["count"] = Json::UInt64(m_pool.count);
+    jPool["claimed"] = Json::UInt64(m_poolUsed);
+    jPool["chunk"] = Json::UInt64(m_chunkSize);
+    jRes["pool"] = jPool;
+
+    return jRes;
+}
@@ -0,0 +1,89 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ Splits the nonce space of a job between miners.
+
+ Each miner gets a range proportional to its hash rate, so that all of them
+ take about as long to search theirs. Part of the space is held back in a
+ shared pool: miners that drain their range early take chunks from it
+ instead of idling, which absorbs errors in the hash rate estimates.
+ Ranges may wrap around 2^64.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <json/json.h>
+
+#include <libdevcore/FixedHash.h>
+
+namespace dev
+{
+namespace eth
+{
+struct NonceRange
+{
+    uint64_t start = 0;
+    uint64_t count = 0;  // Nonces from start on
+};
+
+class NonceAllocator
+{
+public:
+    /**
+     * @brief Splits _count nonces from _start between miners for a new job
+     * _hashRates holds one rate per miner, negative for a miner not mining.
+     * Miners without a rate yet get the average share, all of them an
+     * equal share if none has one.
+     */
+    void reset(h256 const& _header, uint64_t _start, uint64_t _count,
+        std::vector<float> const& _hashRates);
+
+    /**
+     * @brief Range given to _miner by the last reset()
+     */
+    NonceRange range(unsigned _miner) const;
+
+    /**
+     * @brief Takes a chunk of at least _min nonces from the shared pool
+     * Fails once the pool is drained or if _header is not the current job.
+     */
+    bool claim(unsigned _miner, h256 const& _header, uint64_t _min, NonceRange& _chunk);
+
+    Json::Value json() const;
+
+private:
+    static constexpr unsigned c_poolDivisor = 8;  // Part of the space held back in the pool
+    static constexpr unsigned c_chunkDivisor = 16;  // Chunks per miner in the pool
+
+    mutable std::mutex x_ranges;
+    h256 m_header;
+    std::vector<NonceRange> m_ranges;
+    std::vector<float> m_hashRates;  // As given to reset()
+    std::vector<double> m_weights;     // Share of the space, per miner
+    std::vector<uint64_t> m_claimed;   // Nonces taken from the pool, per miner
+    std::vector<unsigned> m_chunks;    // Chunks taken from the pool, per miner
+    NonceRange m_pool;
+    uint64_t m_poolUsed = 0;
+    uint64_t m_chunkSize = 0;
+};
+
+}  // namespace eth
+}  // namespace dev
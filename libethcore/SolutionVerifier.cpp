@@ -0,0 +1,136 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <libdevcore/Log.h>
+
+#include "SolutionVerifier.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+constexpr size_t c_maxBatch = 8;  // Solutions taken at once by a thread
+}
+
+
+SolutionVerifier::SolutionVerifier(unsigned _threads, Verified _onVerified)
+  : m_onVerified(std::move(_onVerified)), m_threadCount(max(_threads, 1u))
+{
+    for (unsigned i = 0; i < m_threadCount; i++)
+        m_threads.emplace_back(&SolutionVerifier::workLoop, this);
+}
+
+
+SolutionVerifier::~SolutionVerifier()
+{
+    {
+        lock_guard<mutex> l(x_queue);
+        m_stop = true;
+    }
+    m_queueSignal.notify_all();
+    for (auto& t : m_threads)
+        t.join();
+}
+
+
+void SolutionVerifier::submit(Solution const& _s)
+{
+    {
+        lock_guard<mutex> l(x_queue);
+        m_queue.push_back({m_nextSequence++, _s, chrono::steady_clock::now(), false});
+        m_stats.queueDepth = unsigned(m_queue.size()) + m_inFlight;
+        m_stats.maxQueueDepth = max(m_stats.maxQueueDepth, m_stats.queueDepth);
+    }
+    m_queueSignal.notify_one();
+}
+
+
+void SolutionVerifier::workLoop()
+{
+    setThreadName("verify");
+
+    vector<Job> batch;
+    while (true)
+    {
+        bool more;
+        {
+            unique_lock<mutex> l(x_queue);
+            m_queueSignal.wait(l, [this] { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+                return;
+
+            // Share a burst with the other threads instead of taking it all
+            const size_t share = (m_queue.size() + m_threadCount - 1) / m_threadCount;
+            const size_t count = min(max<size_t>(share, 1), c_maxBatch);
+            batch.assign(make_move_iterator(m_queue.begin()),
+                make_move_iterator(m_queue.begin() + count));
+            m_queue.erase(m_queue.begin(), m_queue.begin() + count);
+            m_inFlight += unsigned(count);
+            more = !m_queue.empty();
+        }
+        if (more)
+            m_queueSignal.notify_one();
+
+        for (auto& job : batch)
+        {
+            const Solution& s = job.solution;
+            Result r = EthashAux::eval(s.work.epoch, s.work.header, s.nonce);
+            job.valid = r.value <= s.work.boundary;
+        }
+
+        deliver(batch);
+    }
+}
+
+
+void SolutionVerifier::deliver(vector<Job>& _batch)
+{
+    lock_guard<mutex> l(x_deliver);
+    for (auto& job : _batch)
+        m_pending.emplace(job.sequence, std::move(job));
+    _batch.clear();
+
+    // Hand over every solution whose predecessors are all delivered
+    for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_nextDelivery;
+         it = m_pending.erase(it), m_nextDelivery++)
+    {
+        const Job& job = it->second;
+        m_onVerified(job.solution, job.valid);
+
+        const double latency =
+            chrono::duration<double, milli>(chrono::steady_clock::now() - job.submitted).count();
+        lock_guard<mutex> lq(x_queue);
+        m_inFlight--;
+        m_stats.queueDepth = unsigned(m_queue.size()) + m_inFlight;
+        m_stats.verified++;
+        if (!job.valid)
+            m_stats.invalid++;
+        m_stats.avgLatencyMs += (latency - m_stats.avgLatencyMs) / double(m_stats.verified);
+        m_stats.maxLatencyMs = max(m_stats.maxLatencyMs, latency);
+    }
+}
+
+
+VerifierStats SolutionVerifier::stats() const
+{
+    lock_guard<mutex> l(x_queue);
+    return m_stats;
+}
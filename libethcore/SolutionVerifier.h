@@ -0,0 +1,106 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ Pool of threads re-evaluating solutions found by miners.
+
+ Solutions are evaluated in parallel; a thread takes several of them at
+ once when they queue up. Results are delivered in the order solutions
+ were submitted, whatever the order their evaluation completes in.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EthashAux.h"
+
+namespace dev
+{
+namespace eth
+{
+struct VerifierStats
+{
+    unsigned queueDepth = 0;     // Solutions waiting or being evaluated
+    unsigned maxQueueDepth = 0;  // Highest queue depth seen
+    uint64_t verified = 0;       // Solutions evaluated
+    uint64_t invalid = 0;        // Of which not meeting their boundary
+    double avgLatencyMs = 0.0;   // From submission to delivery
+    double maxLatencyMs = 0.0;
+};
+
+class SolutionVerifier
+{
+public:
+    using Verified = std::function<void(Solution const&, bool _valid)>;
+
+    /**
+     * @param _threads Number of evaluating threads
+     * @param _onVerified Called with each solution and whether it is valid,
+     *                    in submission order, from one verifier thread at a time
+     */
+    SolutionVerifier(unsigned _threads, Verified _onVerified);
+    ~SolutionVerifier();
+
+    SolutionVerifier(const SolutionVerifier&) = delete;
+    SolutionVerifier& operator=(const SolutionVerifier&) = delete;
+
+    void submit(Solution const& _s);
+
+    VerifierStats stats() const;
+
+private:
+    struct Job
+    {
+        uint64_t sequence;
+        Solution solution;
+        std::chrono::steady_clock::time_point submitted;
+        bool valid;
+    };
+
+    void workLoop();
+    void deliver(std::vector<Job>& _batch);
+
+    Verified m_onVerified;
+    const unsigned m_threadCount;
+    std::vector<std::thread> m_threads;
+    bool m_stop = false;
+
+    mutable std::mutex x_queue;
+    std::condition_variable m_queueSignal;
+    std::deque<Job> m_queue;
+    uint64_t m_nextSequence = 0;
+
+    // Evaluated ahead of an earlier solution, by sequence
+    std::mutex x_deliver;
+    std::map<uint64_t, Job> m_pending;
+    uint64_t m_nextDelivery = 0;
+
+    // Guarded by x_queue
+    unsigned m_inFlight = 0;
+    VerifierStats m_stats;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,167 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include "TelemetryHistory.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+TelemetrySample makeSample(const TelemetryAccountType& _account, uint32_t _time)
+{
+    TelemetrySample s;
+    s.time = _time;
+    s.hashrate = _account.hashrate;
+    s.powerW = float(_account.sensors.powerW);
+    s.tempC = int16_t(_account.sensors.tempC);
+    s.fanP = uint8_t(_account.sensors.fanP);
+    s.paused = _account.paused;
+    s.accepted = _account.solutions.accepted;
+    s.rejected = _account.solutions.rejected;
+    s.wasted = _account.solutions.wasted;
+    s.failed = _account.solutions.failed;
+    return s;
+}
+
+}  // namespace
+
+
+TelemetryHistory::TelemetryHistory(unsigned _retention, unsigned _intervalMs)
+  : m_retention(_retention),
+    m_capacity(max<size_t>(uint64_t(_retention) * 1000 / max(_intervalMs, 1u), 1))
+{}
+
+
+void TelemetryHistory::append(Series& _series, const TelemetrySample& _sample)
+{
+    if (_series.samples.empty())
+        _series.samples.resize(m_capacity);
+    _series.samples[_series.next] = _sample;
+    _series.next = (_series.next + 1) % m_capacity;
+    _series.size = min(_series.size + 1, m_capacity);
+}
+
+
+void TelemetryHistory::record(const TelemetryType& _telemetry)
+{
+    const uint32_t now = uint32_t(
+        chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch())
+            .count());
+
+    TelemetrySample farm = makeSample(_telemetry.farm, now);
+    for (auto const& miner : _telemetry.miners)
+    {
+        farm.powerW += float(miner.sensors.powerW);
+        farm.tempC = max(farm.tempC, int16_t(miner.sensors.tempC));
+        farm.fanP = max(farm.fanP, uint8_t(miner.sensors.fanP));
+    }
+
+    Guard l(x_series);
+    append(m_farm, farm);
+    if (m_miners.size() < _telemetry.miners.size())
+        m_miners.resize(_telemetry.miners.size());
+    for (size_t i = 0; i < _telemetry.miners.size(); i++)
+        append(m_miners[i], makeSample(_telemetry.miners[i], now));
+}
+
+
+Json::Value TelemetryHistory::columns()
+{
+    Json::Value jRes = Json::Value(Json::arrayValue);
+    for (auto name : {"time", "hashrate", "temperature", "fan", "power", "accepted", "rejected",
+             "wasted", "failed", "paused"})
+        jRes.append(name);
+    return jRes;
+}
+
+
+Json::Value TelemetryHistory::downsample(
+    const Series& _series, uint32_t _from, uint32_t _to, unsigned _step) const
+{
+    Json::Value jRes = Json::Value(Json::arrayValue);
+
+    // Sums of the samples of the current step
+    uint32_t stepStart = 0;
+    unsigned count = 0;
+    unsigned paused = 0;
+    double hashrate = 0.0, tempC = 0.0, fanP = 0.0, powerW = 0.0;
+    const TelemetrySample* last = nullptr;
+
+    auto flush = [&]() {
+        if (!count)
+            return;
+        Json::Value row = Json::Value(Json::arrayValue);
+        row.append(Json::UInt64(stepStart));
+        row.append(hashrate / count);
+        row.append(tempC / count);
+        row.append(fanP / count);
+        row.append(powerW / count);
+        row.append(Json::UInt64(last->accepted));
+        row.append(Json::UInt64(last->rejected));
+        row.append(Json::UInt64(last->wasted));
+        row.append(Json::UInt64(last->failed));
+        row.append(double(paused) / count);
+        jRes.append(row);
+        count = paused = 0;
+        hashrate = tempC = fanP = powerW = 0.0;
+    };
+
+    // Oldest first
+    const size_t first = (_series.next + m_capacity - _series.size) % m_capacity;
+    for (size_t i = 0; i < _series.size; i++)
+    {
+        const TelemetrySample& s = _series.samples[(first + i) % m_capacity];
+        if (s.time < _from || s.time > _to)
+            continue;
+        const uint32_t start = s.time - s.time % _step;
+        if (start != stepStart)
+            flush();
+        stepStart = start;
+        count++;
+        paused += s.paused ? 1 : 0;
+        hashrate += s.hashrate;
+        tempC += s.tempC;
+        fanP += s.fanP;
+        powerW += s.powerW;
+        last = &s;
+    }
+    flush();
+    return jRes;
+}
+
+
+Json::Value TelemetryHistory::range(uint32_t _from, uint32_t _to, unsigned _step) const
+{
+    _step = max(_step, 1u);
+
+    Json::Value jRes;
+    jRes["step"] = _step;
+    jRes["columns"] = columns();
+
+    Guard l(x_series);
+    jRes["farm"] = downsample(m_farm, _from, _to, _step);
+    Json::Value jDevices = Json::Value(Json::arrayValue);
+    for (auto const& miner : m_miners)
+        jDevices.append(downsample(miner, _from, _to, _step));
+    jRes["devices"] = jDevices;
+    return jRes;
+}
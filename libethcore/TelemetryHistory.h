@@ -0,0 +1,105 @@
+/*
+ This file is part of ethminer.
+
+ ethminer is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ ethminer is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with ethminer.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ In-memory history of the telemetry, for monitoring without constant polling.
+
+ The farm and each miner have a ring of samples, one per collect tick,
+ sized once for the retention: memory doesn't grow with the run time and
+ the oldest samples are overwritten. Ranges are read back downsampled to
+ steps aligned on the Unix time, so that successive reads of a monitor
+ line up.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <json/json.h>
+
+#include <libdevcore/Guards.h>
+
+#include "Miner.h"
+
+namespace dev
+{
+namespace eth
+{
+struct TelemetrySample
+{
+    uint32_t time = 0;  // Unix time, in seconds
+    float hashrate = 0.0f;
+    float powerW = 0.0f;
+    int16_t tempC = 0;
+    uint8_t fanP = 0;
+    bool paused = false;
+    uint32_t accepted = 0;  // Solutions since the start
+    uint32_t rejected = 0;
+    uint32_t wasted = 0;
+    uint32_t failed = 0;
+};
+
+class TelemetryHistory
+{
+public:
+    /**
+     * @brief Keeps _retention seconds of samples taken every _intervalMs
+     */
+    TelemetryHistory(unsigned _retention, unsigned _intervalMs);
+
+    /**
+     * @brief Appends a sample of the farm and of each miner
+     * Farm sensors are the hottest miner's temperature and fan, and the
+     * total power.
+     */
+    void record(const TelemetryType& _telemetry);
+
+    /**
+     * @brief Samples within [_from, _to] averaged over _step seconds
+     * Each row holds the columns of columns(): the start of the step,
+     * averages of the hashrate and sensors, solution counts at the end of
+     * the step and the share of samples paused. Steps without samples are
+     * left out.
+     */
+    Json::Value range(uint32_t _from, uint32_t _to, unsigned _step) const;
+
+    static Json::Value columns();
+
+    unsigned retention() const { return m_retention; }
+
+private:
+    struct Series
+    {
+        std::vector<TelemetrySample> samples;  // Ring, allocated to the capacity at once
+        size_t next = 0;
+        size_t size = 0;
+    };
+
+    void append(Series& _series, const TelemetrySample& _sample);
+    Json::Value downsample(const Series& _series, uint32_t _from, uint32_t _to, unsigned _step) const;
+
+    const unsigned m_retention;
+    const size_t m_capacity;
+
+    mutable Mutex x_series;
+    Series m_farm;
+    std::vector<Series> m_miners;
+};
+
+}  // namespace eth
+}  // namespace dev
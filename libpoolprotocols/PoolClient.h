@@ -96,6 +96,7 @@ public:
     using Connected = function<void()>;
     using WorkReceived = function<void(WorkPackage const&)>;
     using PoWEvent = function<void()>;
+    using EpochHint = function<void(h256 const& _seed)>;
 
     void onSolutionAccepted(SolutionAccepted const& _handler) { m_onSolutionAccepted = _handler; }
     void onSolutionRejected(SolutionRejected const& _handler) { m_onSolutionRejected = _handler; }
@@ -104,6 +105,7 @@ public:
     void onWorkReceived(WorkReceived const& _handler) { m_onWorkReceived = _handler; }
     void onPoWStart(PoWEvent const& _handler) { m_onPoWStart = _handler; }
     void onPowEnd(PoWEvent const& _handler) { m_onPoWEnd = _handler; }
+    void onEpochHint(EpochHint const& _handler) { m_onEpochHint = _handler; }
 
 protected:
     unique_ptr<Session> m_session = nullptr;
@@ -121,6 +123,7 @@ protected:
     WorkReceived m_onWorkReceived;
     PoWEvent m_onPoWStart;
     PoWEvent m_onPoWEnd;
+    EpochHint m_onEpochHint;  // Seed of the upcoming PoW window, before it opens
 };
 }  // namespace eth
 }  // namespace dev
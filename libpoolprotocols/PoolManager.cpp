@@ -52,7 +52,9 @@ PoolManager::PoolManager(PoolSettings _settings)
         return false;
     });
 
-    if (m_Settings.clearDAGPoWEnd && m_Settings.startPoWEarlier == 1)
+    // Generating the DAG again takes a while: start early to hide it
+    if (m_Settings.standbyPoWEnd && m_Settings.standbyMode == DagStandbyEnum::Clear &&
+        m_Settings.startPoWEarlier == 1)
     {
         m_Settings.startPoWEarlier = 60;
     }
@@ -164,6 +166,8 @@ void PoolManager::setClientHandlers()
     });
 
     p_client->onWorkReceived([&](WorkPackage const& wp) {
+        const auto received = std::chrono::steady_clock::now();
+
         // client will send dummy work to pause the workers
         // if (!wp)
         //     return;
@@ -210,7 +214,14 @@ void PoolManager::setClientHandlers()
               << (m_currentWp.block != -1 ? (" block " + to_string(m_currentWp.block)) : "")
               << EthReset << " " << m_selectedHost;
 
-        Farm::f().setWork(m_currentWp);
+        Farm::f().setWork(m_currentWp, received);
+    });
+
+    p_client->onEpochHint([&](h256 const& _seed) {
+        if (_seed == h256())
+            return;
+        Farm::f().prepareEpoch(
+            ethash::find_epoch_number(ethash::hash256_from_bytes(_seed.data())));
     });
 
     p_client->onSolutionAccepted(
@@ -219,6 +230,7 @@ void PoolManager::setClientHandlers()
             ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
                << m_selectedHost;
             cnote << EthLime "**Accepted" << (_asStale ? " stale": "") << EthReset << ss.str();
+            Farm::f().latency().solutionAck.record(_responseDelay);
             Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
         });
 
@@ -228,6 +240,7 @@ void PoolManager::setClientHandlers()
             ss << std::setw(4) << std::setfill(' ') << _responseDelay.count() << " ms. "
                << m_selectedHost;
             cwarn << EthRed "**Rejected" EthReset << ss.str();
+            Farm::f().latency().solutionAck.record(_responseDelay);
             Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
         });
 
@@ -252,12 +265,8 @@ void PoolManager::setClientHandlers()
     });
 
     p_client->onPowEnd([&]() {
-        if (m_Settings.clearDAGPoWEnd)
-        {
-            Farm::f().pause();
-            std::this_thread::sleep_for(std::chrono::seconds(5));
-            Farm::f().clearMinerDAG();
-        }
+        if (m_Settings.standbyPoWEnd)
+            Farm::f().standby(m_Settings.standbyMode);
         if (m_Settings.sysCallbackPoWEnd.size() == 0)
         {
             return;
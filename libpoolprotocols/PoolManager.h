@@ -36,7 +36,8 @@ struct PoolSettings
     unsigned benchmarkBlock = 0;        // Block number used by SimulateClient to test performances
     std::string sysCallbackPoWStart = "";  // system command to call when PoW start
     std::string sysCallbackPoWEnd = "";    // system command to call when PoW end
-    bool clearDAGPoWEnd = false;           // release GPU memory when PoW end
+    bool standbyPoWEnd = false;            // put miners in standby when PoW end
+    DagStandbyEnum standbyMode = DagStandbyEnum::Resident;  // what they do with their DAG meanwhile
     bool callPoWEndAtStartup = false;      // call pow-end system command at startup
     unsigned startPoWEarlier = 1;          // PoW start earlier in this number of seconds
 };
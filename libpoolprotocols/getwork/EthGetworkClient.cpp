@@ -455,6 +455,11 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
                         m_pow_window_timeout = false;
                     }
 
+                    // Between windows the seed tells the epoch of the next one
+                    if (!zilPowRuning && !m_zil_pow_running && strSeed.size() > 0 &&
+                        m_onEpochHint)
+                        m_onEpochHint(newWp.seed);
+
                     // check if it's the first work in PoW window
                     if ((zilPowRuning || zilSecsToNextPoW <= m_powstart_seconds) &&
                         !m_pow_window_timeout && !m_zil_pow_running)
@@ -482,7 +487,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
                     }
                 }
 
-                newWp.job = newWp.header.hex();
+                newWp.job.assign(newWp.header.hex());
                 if (m_current.header != newWp.header || m_current.boundary != newWp.boundary)
                 {
                     // if not ZIL mode or ZIL PoW is running, send work to pool
@@ -1309,7 +1309,12 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
 
             if (jPrm.isArray() && !jPrm.empty())
             {
-                m_current.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+                if (!m_current.job.assign(jPrm.get(Json::Value::ArrayIndex(0), "").asString()))
+                {
+                    cwarn << "Got job id longer than " << JobId::c_capacity
+                          << " characters. Discarding ...";
+                    return;
+                }
 
                 if (m_conn->StratumMode() == EthStratumClient::ETHEREUMSTRATUM)
                 {
@@ -1410,7 +1415,12 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
             }
 
             jPrm = responseObject["params"];
-            m_current.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+            if (!m_current.job.assign(jPrm.get(Json::Value::ArrayIndex(0), "").asString()))
+            {
+                cwarn << "Got job id longer than " << JobId::c_capacity
+                      << " characters. Discarding ...";
+                return;
+            }
             m_current.block =
                 stoul(jPrm.get(Json::Value::ArrayIndex(1), "").asString(), nullptr, 16);
 
@@ -1420,7 +1430,7 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
             m_current.header = h256(header);
             m_current.boundary = h256(m_session->nextWorkBoundary.hex(HexPrefix::Add));
             m_current.epoch = m_session->epoch;
-            m_current.algo = m_session->algo;
+            m_current.algo = algoFromName(m_session->algo);
             m_current.startNonce = m_session->extraNonce;
             m_current.exSizeBytes = m_session->extraNonceSizeBytes;
             m_current_timestamp = std::chrono::steady_clock::now();
@@ -1608,7 +1618,7 @@ void EthStratumClient::submitSolution(const Solution& solution)
 
         jReq["jsonrpc"] = "2.0";
         jReq["params"].append(m_conn->User());
-        jReq["params"].append(solution.work.job);
+        jReq["params"].append(solution.work.job.str());
         jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
         jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
         jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
@@ -1631,14 +1641,14 @@ void EthStratumClient::submitSolution(const Solution& solution)
     case EthStratumClient::ETHEREUMSTRATUM:
 
         jReq["params"].append(m_conn->UserDotWorker());
-        jReq["params"].append(solution.work.job);
+        jReq["params"].append(solution.work.job.str());
         jReq["params"].append(
             toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
         break;
         
     case EthStratumClient::ETHEREUMSTRATUM2:
 
-        jReq["params"].append(solution.work.job);
+        jReq["params"].append(solution.work.job.str());
         jReq["params"].append(
             toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
         jReq["params"].append(m_session->workerId);